@@ -10,10 +10,13 @@ plt.figure(figsize=(12, 6))
 # Стили и цвет
 styles = {
     'Linear':     {'label': 'Linear',     'color': 'tab:blue',   'marker': 'o'},
+    'LinearSimd': {'label': 'Linear SIMD', 'color': 'tab:cyan',  'marker': 'o'},
     'BST':        {'label': 'BST',        'color': 'tab:orange', 'marker': 'o'},
     'RBT':        {'label': 'RBT',        'color': 'tab:green',  'marker': 'o'},
     'Hash':       {'label': 'Hash',       'color': 'tab:red',    'marker': 'o'},
     'Multimap':   {'label': 'Multimap',   'color': 'tab:purple', 'marker': 'o'},
+    'Eytzinger':  {'label': 'Eytzinger',  'color': 'tab:brown',  'marker': 'o'},
+    'BPlus':      {'label': 'B+-tree',    'color': 'tab:olive',  'marker': 'o'},
 }
 
 # Построение линий
@@ -27,7 +30,7 @@ for column, style in styles.items():
 # Настройки осей
 plt.yscale('log')
 plt.xlabel("Размер массива", fontsize=12)
-plt.ylabel("Время поиска (лог. шкала)", fontsize=12)
+plt.ylabel("Медиана времени поиска, нс (лог. шкала)", fontsize=12)
 plt.title("Сравнение алгоритмов поиска", fontsize=14)
 
 # Сетка и легенда
@@ -37,4 +40,28 @@ plt.tight_layout()
 
 # Сохранение
 plt.savefig("comparison_cleaned.png")
+
+# Разброс: медиана и p99 по замерам из lookup_stats.csv
+stats = pd.read_csv("lookup_stats.csv")
+plt.figure(figsize=(12, 6))
+for column, style in styles.items():
+    part = stats[stats['Structure'] == column]
+    if part.empty:
+        continue
+    plt.plot(part['Size'], part['MedianNs'],
+             label=style['label'],
+             color=style['color'],
+             marker=style['marker'],
+             linewidth=2)
+    plt.fill_between(part['Size'], part['MedianNs'], part['P99Ns'],
+                     color=style['color'], alpha=0.15)
+
+plt.yscale('log')
+plt.xlabel("Размер массива", fontsize=12)
+plt.ylabel("Время поиска, нс: медиана и p99 (лог. шкала)", fontsize=12)
+plt.title("Разброс времени поиска", fontsize=14)
+plt.grid(True, which="both", linestyle='--', linewidth=0.5)
+plt.legend()
+plt.tight_layout()
+plt.savefig("comparison_p99.png")
 plt.show()
\ No newline at end of file
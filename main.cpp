@@ -7,307 +7,5516 @@
 #include <random>
 #include <algorithm>
 #include <sstream>
+#include <string_view>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <charconv>
+#include <span>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <latch>
+#include <queue>
+#include <deque>
+#include <unordered_set>
+#include <functional>
+#include <cmath>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <stdexcept>
+#include <malloc.h>
+#include <array>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <optional>
+#include <concepts>
+#include <csignal>
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
 
-// Структура данных
-struct Data {
-    std::string key;
-    int value;
+// Номер строки в таблице
+using RowId = uint32_t;
+// Номер уникального ФИО в словаре; номера идут в порядке строк
+using KeyId = uint32_t;
+const KeyId NO_KEY = UINT32_MAX;
+
+// Колоночное хранилище квартир: по массиву на поле,
+// ФИО лежат подряд в одной строке-арене
+struct ApartmentTable {
+    std::vector<uint16_t> apartment;
+    std::vector<uint16_t> area;
+    std::vector<uint8_t> rooms;
+    std::vector<float> price;
+    std::vector<uint8_t> floor;
+    std::vector<uint32_t> keyOffset{0}; // ФИО строки i: names[keyOffset[i], keyOffset[i + 1])
+    std::string names;
+
+    size_t size() const { return apartment.size(); }
+    bool empty() const { return apartment.empty(); }
+
+    std::string_view key(RowId row) const {
+        return std::string_view(names.data() + keyOffset[row], keyOffset[row + 1] - keyOffset[row]);
+    }
+
+    // Дописывает строку в конец таблицы
+    RowId append(uint16_t apt, uint16_t areaValue, uint8_t roomsValue, float priceValue, uint8_t floorValue,
+                 std::string_view name) {
+        apartment.push_back(apt);
+        area.push_back(areaValue);
+        rooms.push_back(roomsValue);
+        price.push_back(priceValue);
+        floor.push_back(floorValue);
+        names.append(name);
+        keyOffset.push_back(static_cast<uint32_t>(names.size()));
+        return static_cast<RowId>(size() - 1);
+    }
+
+    // Дописывает все строки other
+    void append(const ApartmentTable& other) {
+        apartment.insert(apartment.end(), other.apartment.begin(), other.apartment.end());
+        area.insert(area.end(), other.area.begin(), other.area.end());
+        rooms.insert(rooms.end(), other.rooms.begin(), other.rooms.end());
+        price.insert(price.end(), other.price.begin(), other.price.end());
+        floor.insert(floor.end(), other.floor.begin(), other.floor.end());
+        uint32_t base = static_cast<uint32_t>(names.size());
+        names.append(other.names);
+        for (size_t i = 1; i < other.keyOffset.size(); ++i) keyOffset.push_back(base + other.keyOffset[i]);
+    }
+
+    // Выделит ли append память под строку с ФИО длины nameBytes
+    bool appendReallocates(size_t nameBytes) const {
+        return apartment.size() == apartment.capacity() || area.size() == area.capacity() ||
+               rooms.size() == rooms.capacity() || price.size() == price.capacity() ||
+               floor.size() == floor.capacity() || keyOffset.size() == keyOffset.capacity() ||
+               names.size() + nameBytes > names.capacity();
+    }
+
+    void reserve(size_t rows, size_t nameBytes) {
+        apartment.reserve(rows);
+        area.reserve(rows);
+        rooms.reserve(rows);
+        price.reserve(rows);
+        floor.reserve(rows);
+        keyOffset.reserve(rows + 1);
+        names.reserve(nameBytes);
+    }
+};
+
+// Результаты пакетного поиска: строки для i-го ключа —
+// rows[offsets[i], offsets[i + 1]). Буфер переиспользуется между пакетами.
+struct BatchResult {
+    std::vector<RowId> rows;
+    std::vector<uint32_t> offsets{0};
+
+    void clear() {
+        rows.clear();
+        offsets.assign(1, 0);
+    }
+
+    void add(const RowId* first, size_t count) {
+        rows.insert(rows.end(), first, first + count);
+        offsets.push_back(static_cast<uint32_t>(rows.size()));
+    }
+
+    size_t size() const { return offsets.size() - 1; }
+    size_t count(size_t i) const { return offsets[i + 1] - offsets[i]; }
+};
+
+// Сколько поисков пакетные функции ведут одновременно
+const size_t BATCH_GROUP = 16;
+
+// === Учёт памяти ===
+// Глобальные operator new/delete считают живые байты и число выделений.
+// Размер блока берётся из malloc_usable_size, поэтому учитываются
+// и байты, которые аллокатор добавил к запросу.
+std::atomic<size_t> liveBytesCounter{0};
+std::atomic<size_t> allocationCounter{0};
+
+struct AllocStats {
+    size_t liveBytes;
+    size_t allocations;
+};
+
+AllocStats allocStats() {
+    return {liveBytesCounter.load(std::memory_order_relaxed), allocationCounter.load(std::memory_order_relaxed)};
+}
+
+// Учитывает блок p; nullptr пропускает как есть (для nothrow-версий new)
+inline void* countedAlloc(void* p, const std::nothrow_t&) noexcept {
+    if (!p) return nullptr;
+    liveBytesCounter.fetch_add(malloc_usable_size(p), std::memory_order_relaxed);
+    allocationCounter.fetch_add(1, std::memory_order_relaxed);
+    return p;
+}
+
+inline void* countedAlloc(void* p) {
+    if (!p) throw std::bad_alloc();
+    return countedAlloc(p, std::nothrow);
+}
+
+inline void* alignedAlloc(size_t n, std::align_val_t al) noexcept {
+    size_t a = static_cast<size_t>(al);
+    return std::aligned_alloc(a, (n + a - 1) / a * a);
+}
+
+inline void countedFree(void* p) {
+    if (!p) return;
+    liveBytesCounter.fetch_sub(malloc_usable_size(p), std::memory_order_relaxed);
+    std::free(p);
+}
+
+void* operator new(size_t n) { return countedAlloc(std::malloc(n ? n : 1)); }
+void* operator new[](size_t n) { return countedAlloc(std::malloc(n ? n : 1)); }
+void* operator new(size_t n, std::align_val_t al) { return countedAlloc(alignedAlloc(n, al)); }
+void* operator new[](size_t n, std::align_val_t al) { return operator new(n, al); }
+// nothrow-версии: ими выделяет, например, временный буфер std::stable_sort,
+// а освобождает он обычным delete, поэтому они тоже идут через счётчик
+void* operator new(size_t n, const std::nothrow_t& tag) noexcept { return countedAlloc(std::malloc(n ? n : 1), tag); }
+void* operator new[](size_t n, const std::nothrow_t& tag) noexcept { return countedAlloc(std::malloc(n ? n : 1), tag); }
+void* operator new(size_t n, std::align_val_t al, const std::nothrow_t& tag) noexcept {
+    return countedAlloc(alignedAlloc(n, al), tag);
+}
+void* operator new[](size_t n, std::align_val_t al, const std::nothrow_t& tag) noexcept {
+    return countedAlloc(alignedAlloc(n, al), tag);
+}
+void operator delete(void* p) noexcept { countedFree(p); }
+void operator delete[](void* p) noexcept { countedFree(p); }
+void operator delete(void* p, size_t) noexcept { countedFree(p); }
+void operator delete[](void* p, size_t) noexcept { countedFree(p); }
+void operator delete(void* p, std::align_val_t) noexcept { countedFree(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { countedFree(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { countedFree(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { countedFree(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { countedFree(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { countedFree(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { countedFree(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { countedFree(p); }
+
+// === Хеш-функция ===
+
+inline uint64_t read64(const char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t read32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Умножение 64x64 -> 128 и свёртка половин
+inline uint64_t mix64(uint64_t a, uint64_t b) {
+    __uint128_t r = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+}
+
+// 64-битный хеш в духе wyhash: по 16 байт за шаг
+uint64_t hashKey(std::string_view key) {
+    const uint64_t k0 = 0xa0761d6478bd642full, k1 = 0xe7037ed1a0b428dbull;
+    const char* p = key.data();
+    size_t n = key.size();
+    uint64_t h = k0;
+    for (; n > 16; n -= 16, p += 16) {
+        h = mix64(read64(p) ^ k1, read64(p + 8) ^ h);
+    }
+    uint64_t a = 0, b = 0;
+    if (n >= 8) {
+        a = read64(p);
+        b = read64(p + n - 8);
+    }
+    else if (n >= 4) {
+        a = read32(p);
+        b = read32(p + n - 4);
+    }
+    else if (n > 0) {
+        a = (uint64_t(uint8_t(p[0])) << 16) | (uint64_t(uint8_t(p[n >> 1])) << 8) | uint8_t(p[n - 1]);
+    }
+    return mix64(k1 ^ key.size(), mix64(a ^ k1, b ^ h));
+}
+
+// === Инструментация поиска ===
+// Сборка с -DSEARCH_STATS считает для каждого поиска длину пробы в
+// хеш-таблице, пройденные узлы, сравнения строк и сравнённые байты и
+// складывает их в гистограммы по структурам. Без флага счётчики —
+// пустые inline-функции и ничего не стоят.
+enum StatsSlot { STATS_LINEAR, STATS_BST, STATS_RBT, STATS_HASH, STATS_MULTIMAP, STATS_SLOTS };
+const char* const statsSlotNames[STATS_SLOTS] = {"Linear", "BST", "RBT", "Hash", "Multimap"};
+
+// Значения до 16 — по одному на корзину, дальше корзины по степеням двойки
+struct Histogram {
+    std::vector<uint64_t> buckets;
+
+    static size_t bucketOf(uint64_t v) {
+        return v < 16 ? v : 12 + (63 - __builtin_clzll(v));
+    }
+    static uint64_t bucketLow(size_t b) {
+        return b < 16 ? b : uint64_t(1) << (b - 12);
+    }
+
+    void add(uint64_t v) {
+        size_t b = bucketOf(v);
+        if (b >= buckets.size()) buckets.resize(b + 1);
+        buckets[b]++;
+    }
+};
+
+struct LookupCounters {
+    uint64_t probes = 0, nodes = 0, compares = 0, bytes = 0;
+};
+
+struct SearchStats {
+    Histogram probes, nodes, compares, bytes;
+    uint64_t lookups = 0, nodesTotal = 0; // для среднего числа узлов на поиск
+};
+
+#ifdef SEARCH_STATS
+const bool searchStatsEnabled = true;
+// По потоку, чтобы параллельные сборки не гонялись за счётчики
+thread_local LookupCounters lookupCounters;
+thread_local SearchStats searchStats[STATS_SLOTS];
+
+inline void countProbe() { lookupCounters.probes++; }
+inline void countNode() { lookupCounters.nodes++; }
+inline void countCompare(std::string_view a, std::string_view b) {
+    size_t n = std::min(a.size(), b.size());
+    size_t same = std::mismatch(a.begin(), a.begin() + n, b.begin()).first - a.begin();
+    lookupCounters.compares++;
+    lookupCounters.bytes += std::min(same + 1, n);
+}
+inline void countCompare(KeyId, KeyId) {
+    lookupCounters.compares++;
+    lookupCounters.bytes += sizeof(KeyId);
+}
+
+// Обнуляет счётчики в начале поиска и переносит их в гистограммы в конце
+struct LookupScope {
+    StatsSlot slot;
+    explicit LookupScope(StatsSlot s) : slot(s) { lookupCounters = {}; }
+    ~LookupScope() {
+        SearchStats& st = searchStats[slot];
+        st.probes.add(lookupCounters.probes);
+        st.nodes.add(lookupCounters.nodes);
+        st.compares.add(lookupCounters.compares);
+        st.bytes.add(lookupCounters.bytes);
+        st.lookups++;
+        st.nodesTotal += lookupCounters.nodes;
+    }
+};
+#else
+const bool searchStatsEnabled = false;
+SearchStats searchStats[STATS_SLOTS];
+
+inline void countProbe() {}
+inline void countNode() {}
+inline void countCompare(std::string_view, std::string_view) {}
+inline void countCompare(KeyId, KeyId) {}
+
+struct LookupScope {
+    explicit LookupScope(StatsSlot) {}
+};
+#endif
+
+inline int compareKeys(std::string_view a, std::string_view b) {
+    countCompare(a, b);
+    return a.compare(b);
+}
+
+inline bool keysEqual(std::string_view a, std::string_view b) {
+    countCompare(a, b);
+    return a == b;
+}
+
+inline int compareKeys(KeyId a, KeyId b) {
+    countCompare(a, b);
+    return (a > b) - (a < b);
+}
+
+// Сравнение для std::multimap: каждое сравнение — один пройденный узел
+struct CountingLess {
+    bool operator()(std::string_view a, std::string_view b) const {
+        countNode();
+        return compareKeys(a, b) < 0;
+    }
 };
 
+void writeSearchHistograms(std::ostream& out, int size) {
+    for (int s = 0; s < STATS_SLOTS; ++s) {
+        const SearchStats& st = searchStats[s];
+        std::pair<const char*, const Histogram*> metrics[] = {
+            {"Probes", &st.probes}, {"Nodes", &st.nodes}, {"Compares", &st.compares}, {"Bytes", &st.bytes}};
+        for (auto [metric, hist] : metrics) {
+            for (size_t b = 0; b < hist->buckets.size(); ++b) {
+                if (hist->buckets[b] == 0) continue;
+                out << size << "," << statsSlotNames[s] << "," << metric << ","
+                    << Histogram::bucketLow(b) << "," << hist->buckets[b] << "\n";
+            }
+        }
+    }
+}
+
+void resetSearchHistograms() {
+    for (auto& st : searchStats) st = SearchStats();
+}
+
 // === Линейный поиск ===
-std::vector<Data> linearSearch(const std::vector<Data>& data, const std::string& key) {
-    std::vector<Data> results;
-    for (const auto& item : data) {
-        if (item.key == key) results.push_back(item);
+// Поиски, которым нечего вернуть без копирования, дописывают строки
+// в буфер вызывающего: переиспользуемый буфер не выделяет память
+// после того, как вырос до самого частого ФИО. Индексы с готовыми
+// списками строк возвращают std::span на них.
+void linearSearch(const ApartmentTable& table, std::string_view key, std::vector<RowId>& results) {
+    LookupScope scope(STATS_LINEAR);
+    for (RowId row = 0; row < table.size(); ++row) {
+        countNode();
+        if (keysEqual(table.key(row), key)) results.push_back(row);
     }
-    return results;
 }
 
-// === BST ===
-struct BSTNode {
-    Data data;
-    BSTNode* left;
-    BSTNode* right;
-    BSTNode() : left(nullptr), right(nullptr) {}
+// === Векторный линейный поиск по отпечаткам ===
+// Для каждой строки хранится 32-битный отпечаток ключа (старшая половина
+// hashKey). Скан сравнивает 32 отпечатка за итерацию и сверяет полный
+// ключ только у кандидатов.
+inline uint32_t keyFingerprint(std::string_view key) {
+    return static_cast<uint32_t>(hashKey(key) >> 32);
+}
+
+std::vector<uint32_t> buildFingerprints(const ApartmentTable& table) {
+    std::vector<uint32_t> prints(table.size());
+    for (RowId row = 0; row < table.size(); ++row) prints[row] = keyFingerprint(table.key(row));
+    return prints;
+}
+
+// Сканирует строки [begin, end)
+using FingerprintScan = void (*)(const uint32_t* prints, size_t begin, size_t end, uint32_t print,
+                                 const ApartmentTable& table, std::string_view key,
+                                 std::vector<RowId>& results);
+
+void scanFingerprintsScalar(const uint32_t* prints, size_t begin, size_t end, uint32_t print,
+                            const ApartmentTable& table, std::string_view key,
+                            std::vector<RowId>& results) {
+    for (size_t i = begin; i < end; ++i) {
+        if (prints[i] == print && table.key(i) == key) results.push_back(static_cast<RowId>(i));
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Битовая маска совпадений для 8 отпечатков с позиции p
+__attribute__((target("avx2"))) inline uint32_t matchFingerprints8(const uint32_t* p, uint32_t print) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i eq = _mm256_cmpeq_epi32(v, _mm256_set1_epi32(static_cast<int>(print)));
+    return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(eq)));
+}
+
+__attribute__((target("avx2")))
+void scanFingerprintsAvx2(const uint32_t* prints, size_t begin, size_t end, uint32_t print,
+                          const ApartmentTable& table, std::string_view key,
+                          std::vector<RowId>& results) {
+    size_t i = begin;
+    for (; i + 32 <= end; i += 32) {
+        uint32_t mask = matchFingerprints8(prints + i, print) |
+                        matchFingerprints8(prints + i + 8, print) << 8 |
+                        matchFingerprints8(prints + i + 16, print) << 16 |
+                        matchFingerprints8(prints + i + 24, print) << 24;
+        while (mask) {
+            size_t row = i + __builtin_ctz(mask);
+            if (table.key(row) == key) results.push_back(static_cast<RowId>(row));
+            mask &= mask - 1;
+        }
+    }
+    scanFingerprintsScalar(prints, i, end, print, table, key, results);
+}
+#endif
+
+// Выбор реализации по CPUID при первом вызове
+FingerprintScan selectFingerprintScan() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return scanFingerprintsAvx2;
+#endif
+    return scanFingerprintsScalar;
+}
+
+void linearSearchSimd(const ApartmentTable& table, const std::vector<uint32_t>& prints, std::string_view key,
+                      std::vector<RowId>& results) {
+    static const FingerprintScan scan = selectFingerprintScan();
+    scan(prints.data(), 0, prints.size(), keyFingerprint(key), table, key, results);
+}
+
+// === Пул узлов ===
+// Узлы дерева лежат подряд в одном векторе и ссылаются друг на друга
+// 32-битными индексами. Выделение — push_back в конец или узел из
+// списка удалённых, освобождение памяти — всего дерева сразу вместе
+// с пулом.
+using NodeId = uint32_t;
+const NodeId NIL = UINT32_MAX;
+
+template<typename Node>
+struct NodePool {
+    std::vector<Node> nodes;
+    std::vector<NodeId> freeIds; // удалённые узлы; их память не отдаётся до release
+
+    template<typename... Args>
+    NodeId alloc(Args&&... args) {
+        if (!freeIds.empty()) {
+            NodeId id = freeIds.back();
+            freeIds.pop_back();
+            nodes[id] = Node(std::forward<Args>(args)...);
+            return id;
+        }
+        nodes.emplace_back(std::forward<Args>(args)...);
+        return static_cast<NodeId>(nodes.size() - 1);
+    }
+
+    void free(NodeId id) { freeIds.push_back(id); }
+
+    // Выделит ли alloc память (или отдаст старую, переиспользуя узел)
+    bool allocReallocates() const { return !freeIds.empty() || nodes.size() == nodes.capacity(); }
+
+    Node& operator[](NodeId id) { return nodes[id]; }
+    const Node& operator[](NodeId id) const { return nodes[id]; }
+
+    size_t size() const { return nodes.size(); }
+    void reserve(size_t n) { nodes.reserve(n); }
+    size_t bytes() const { return nodes.capacity() * sizeof(Node); }
+
+    void release() {
+        std::vector<Node>().swap(nodes);
+        freeIds.clear();
+    }
 };
 
-void insertBST(BSTNode*& root, const Data& value) {
-    if (!root) {
-        root = new BSTNode;
-        root->data = value;
+// === BST ===
+// Один узел на уникальный ключ, повторы копятся в values, как в RBNode.
+// Key — строка из арены таблицы или номер из KeyDictionary.
+template<typename Key>
+struct BSTNodeT {
+    Key key;
+    std::vector<RowId> values;
+    NodeId left = NIL;
+    NodeId right = NIL;
+
+    BSTNodeT(Key k, RowId row) : key(k) {
+        values.push_back(row);
     }
-    else if (value.key < root->data.key) {
-        insertBST(root->left, value);
+};
+
+template<typename Key>
+struct BSTreeT {
+    NodePool<BSTNodeT<Key>> pool;
+    NodeId root = NIL;
+
+    size_t memoryBytes() const {
+        size_t bytes = pool.bytes();
+        for (const auto& n : pool.nodes) bytes += n.values.capacity() * sizeof(RowId);
+        return bytes;
     }
-    else {
-        insertBST(root->right, value);
+};
+
+using BSTNode = BSTNodeT<std::string_view>;
+using BSTree = BSTreeT<std::string_view>;
+
+template<typename Key>
+void insertBST(BSTreeT<Key>& tree, std::type_identity_t<Key> key, RowId row) {
+    NodeId node = tree.root;
+    NodeId parent = NIL;
+    while (node != NIL) {
+        parent = node;
+        auto& n = tree.pool[node];
+        if (key == n.key) {
+            n.values.push_back(row);
+            return;
+        }
+        node = key < n.key ? n.left : n.right;
     }
+    // alloc может перевыделить пул, поэтому родителя берём по индексу после него
+    NodeId newNode = tree.pool.alloc(key, row);
+    if (parent == NIL) tree.root = newNode;
+    else if (key < tree.pool[parent].key) tree.pool[parent].left = newNode;
+    else tree.pool[parent].right = newNode;
 }
 
-void searchBST(BSTNode* root, const std::string& key, std::vector<Data>& results) {
-    if (!root) return;
-    if (root->data.key == key) results.push_back(root->data);
-    if (key <= root->data.key) searchBST(root->left, key, results);
-    if (key >= root->data.key) searchBST(root->right, key, results);
+template<typename Key>
+void searchBST(const BSTreeT<Key>& tree, std::type_identity_t<Key> key, std::vector<RowId>& results) {
+    LookupScope scope(STATS_BST);
+    NodeId node = tree.root;
+    while (node != NIL) {
+        const auto& n = tree.pool[node];
+        countNode();
+        int cmp = compareKeys(key, n.key);
+        if (cmp == 0) {
+            results.insert(results.end(), n.values.begin(), n.values.end());
+            return;
+        }
+        node = cmp < 0 ? n.left : n.right;
+    }
 }
 
 // === Красно-черное дерево ===
-enum Color { RED, BLACK };
-
-struct RBNode {
-    std::string key;
-    std::vector<Data> values;
-    Color color;
-    RBNode* parent;
-    RBNode* left;
-    RBNode* right;
-
-    RBNode(const std::string& k, const Data& d)
-        : key(k), color(RED), parent(nullptr), left(nullptr), right(nullptr) {
-        values.push_back(d);
-    }
-};
-
-RBNode* rbRoot = nullptr;
-
-void leftRotate(RBNode*& root, RBNode* x) {
-    if (!x || !x->right) return;
-    RBNode* y = x->right;
-    x->right = y->left;
-    if (y->left) y->left->parent = x;
-    y->parent = x->parent;
-    if (!x->parent) root = y;
-    else if (x == x->parent->left) x->parent->left = y;
-    else x->parent->right = y;
-    y->left = x;
-    x->parent = y;
-}
-
-void rightRotate(RBNode*& root, RBNode* x) {
-    if (!x || !x->left) return;
-    RBNode* y = x->left;
-    x->left = y->right;
-    if (y->right) y->right->parent = x;
-    y->parent = x->parent;
-    if (!x->parent) root = y;
-    else if (x == x->parent->right) x->parent->right = y;
-    else x->parent->left = y;
-    y->right = x;
-    x->parent = y;
-}
-
-void fixInsert(RBNode*& root, RBNode* node) {
-    while (node != root && node->parent && node->parent->color == RED) {
-        RBNode* parent = node->parent;
-        RBNode* grand = parent->parent;
-        if (!grand) break;
-
-        if (parent == grand->left) {
-            RBNode* uncle = grand->right;
-            if (uncle && uncle->color == RED) {
-                parent->color = BLACK;
-                uncle->color = BLACK;
-                grand->color = RED;
+enum Color : uint8_t { RED, BLACK };
+
+template<typename Key>
+struct RBNodeT {
+    Key key;
+    std::vector<RowId> values;
+    NodeId parent = NIL;
+    NodeId left = NIL;
+    NodeId right = NIL;
+    Color color = RED;
+
+    RBNodeT(Key k, RowId row) : key(k) {
+        values.push_back(row);
+    }
+};
+
+template<typename Key>
+struct RBTreeT {
+    NodePool<RBNodeT<Key>> pool;
+    NodeId root = NIL;
+
+    size_t memoryBytes() const {
+        size_t bytes = pool.bytes();
+        for (const auto& n : pool.nodes) bytes += n.values.capacity() * sizeof(RowId);
+        return bytes;
+    }
+};
+
+using RBNode = RBNodeT<std::string_view>;
+using RBTree = RBTreeT<std::string_view>;
+
+template<typename Key>
+void leftRotate(RBTreeT<Key>& t, NodeId x) {
+    auto& p = t.pool;
+    if (x == NIL || p[x].right == NIL) return;
+    NodeId y = p[x].right;
+    p[x].right = p[y].left;
+    if (p[y].left != NIL) p[p[y].left].parent = x;
+    p[y].parent = p[x].parent;
+    if (p[x].parent == NIL) t.root = y;
+    else if (x == p[p[x].parent].left) p[p[x].parent].left = y;
+    else p[p[x].parent].right = y;
+    p[y].left = x;
+    p[x].parent = y;
+}
+
+template<typename Key>
+void rightRotate(RBTreeT<Key>& t, NodeId x) {
+    auto& p = t.pool;
+    if (x == NIL || p[x].left == NIL) return;
+    NodeId y = p[x].left;
+    p[x].left = p[y].right;
+    if (p[y].right != NIL) p[p[y].right].parent = x;
+    p[y].parent = p[x].parent;
+    if (p[x].parent == NIL) t.root = y;
+    else if (x == p[p[x].parent].right) p[p[x].parent].right = y;
+    else p[p[x].parent].left = y;
+    p[y].right = x;
+    p[x].parent = y;
+}
+
+template<typename Key>
+void fixInsert(RBTreeT<Key>& t, NodeId node) {
+    auto& p = t.pool;
+    auto isRed = [&](NodeId n) { return n != NIL && p[n].color == RED; };
+    while (node != t.root && isRed(p[node].parent)) {
+        NodeId parent = p[node].parent;
+        NodeId grand = p[parent].parent;
+        if (grand == NIL) break;
+
+        if (parent == p[grand].left) {
+            NodeId uncle = p[grand].right;
+            if (isRed(uncle)) {
+                p[parent].color = BLACK;
+                p[uncle].color = BLACK;
+                p[grand].color = RED;
                 node = grand;
             }
             else {
-                if (node == parent->right) {
+                if (node == p[parent].right) {
                     node = parent;
-                    leftRotate(root, node);
+                    leftRotate(t, node);
                 }
-                parent->color = BLACK;
-                grand->color = RED;
-                rightRotate(root, grand);
+                p[p[node].parent].color = BLACK;
+                p[grand].color = RED;
+                rightRotate(t, grand);
             }
         }
         else {
-            RBNode* uncle = grand->left;
-            if (uncle && uncle->color == RED) {
-                parent->color = BLACK;
-                uncle->color = BLACK;
-                grand->color = RED;
+            NodeId uncle = p[grand].left;
+            if (isRed(uncle)) {
+                p[parent].color = BLACK;
+                p[uncle].color = BLACK;
+                p[grand].color = RED;
                 node = grand;
             }
             else {
-                if (node == parent->left) {
+                if (node == p[parent].left) {
                     node = parent;
-                    rightRotate(root, node);
+                    rightRotate(t, node);
                 }
-                parent->color = BLACK;
-                grand->color = RED;
-                leftRotate(root, grand);
+                p[p[node].parent].color = BLACK;
+                p[grand].color = RED;
+                leftRotate(t, grand);
             }
         }
     }
-    if (root) root->color = BLACK;
+    if (t.root != NIL) p[t.root].color = BLACK;
 }
 
-void insertRBT(RBNode*& root, const Data& d) {
-    RBNode* node = root;
-    RBNode* parent = nullptr;
-    while (node) {
+template<typename Key>
+void insertRBT(RBTreeT<Key>& t, std::type_identity_t<Key> key, RowId row) {
+    NodeId node = t.root;
+    NodeId parent = NIL;
+    while (node != NIL) {
         parent = node;
-        if (d.key == node->key) {
-            node->values.push_back(d);
+        if (key == t.pool[node].key) {
+            t.pool[node].values.push_back(row);
             return;
         }
-        else if (d.key < node->key) node = node->left;
-        else node = node->right;
+        else if (key < t.pool[node].key) node = t.pool[node].left;
+        else node = t.pool[node].right;
     }
-    RBNode* newNode = new RBNode(d.key, d);
-    newNode->parent = parent;
-    if (!parent) root = newNode;
-    else if (d.key < parent->key) parent->left = newNode;
-    else parent->right = newNode;
-    fixInsert(root, newNode);
+    NodeId newNode = t.pool.alloc(key, row);
+    t.pool[newNode].parent = parent;
+    if (parent == NIL) t.root = newNode;
+    else if (key < t.pool[parent].key) t.pool[parent].left = newNode;
+    else t.pool[parent].right = newNode;
+    fixInsert(t, newNode);
 }
 
-std::vector<Data> searchRBT(RBNode* root, const std::string& key) {
-    RBNode* node = root;
-    while (node) {
-        if (key == node->key) return node->values;
-        else if (key < node->key) node = node->left;
-        else node = node->right;
+template<typename Key>
+std::span<const RowId> searchRBT(const RBTreeT<Key>& t, std::type_identity_t<Key> key) {
+    LookupScope scope(STATS_RBT);
+    NodeId node = t.root;
+    while (node != NIL) {
+        const auto& n = t.pool[node];
+        countNode();
+        int cmp = compareKeys(key, n.key);
+        if (cmp == 0) return n.values;
+        else if (cmp < 0) node = n.left;
+        else node = n.right;
     }
     return {};
 }
 
-// === Хеш-таблица с открытой адресацией ===
-struct HashEntry {
-    bool occupied = false;
-    Data data;
-};
+// Ставит поддерево v на место узла u
+template<typename Key>
+void transplantRBT(RBTreeT<Key>& t, NodeId u, NodeId v) {
+    auto& p = t.pool;
+    NodeId parent = p[u].parent;
+    if (parent == NIL) t.root = v;
+    else if (u == p[parent].left) p[parent].left = v;
+    else p[parent].right = v;
+    if (v != NIL) p[v].parent = parent;
+}
+
+// Восстановление после удаления чёрного узла. Узла-стража нет, поэтому
+// x может быть NIL, и его родитель передаётся отдельно.
+template<typename Key>
+void fixErase(RBTreeT<Key>& t, NodeId x, NodeId parent) {
+    auto& p = t.pool;
+    auto isRed = [&](NodeId n) { return n != NIL && p[n].color == RED; };
+    while (x != t.root && !isRed(x)) {
+        if (x == p[parent].left) {
+            NodeId w = p[parent].right;
+            if (isRed(w)) {
+                p[w].color = BLACK;
+                p[parent].color = RED;
+                leftRotate(t, parent);
+                w = p[parent].right;
+            }
+            if (!isRed(p[w].left) && !isRed(p[w].right)) {
+                p[w].color = RED;
+                x = parent;
+                parent = p[x].parent;
+            }
+            else {
+                if (!isRed(p[w].right)) {
+                    p[p[w].left].color = BLACK;
+                    p[w].color = RED;
+                    rightRotate(t, w);
+                    w = p[parent].right;
+                }
+                p[w].color = p[parent].color;
+                p[parent].color = BLACK;
+                p[p[w].right].color = BLACK;
+                leftRotate(t, parent);
+                x = t.root;
+            }
+        }
+        else {
+            NodeId w = p[parent].left;
+            if (isRed(w)) {
+                p[w].color = BLACK;
+                p[parent].color = RED;
+                rightRotate(t, parent);
+                w = p[parent].left;
+            }
+            if (!isRed(p[w].left) && !isRed(p[w].right)) {
+                p[w].color = RED;
+                x = parent;
+                parent = p[x].parent;
+            }
+            else {
+                if (!isRed(p[w].left)) {
+                    p[p[w].right].color = BLACK;
+                    p[w].color = RED;
+                    leftRotate(t, w);
+                    w = p[parent].left;
+                }
+                p[w].color = p[parent].color;
+                p[parent].color = BLACK;
+                p[p[w].left].color = BLACK;
+                rightRotate(t, parent);
+                x = t.root;
+            }
+        }
+    }
+    if (x != NIL) p[x].color = BLACK;
+}
 
-struct HashTable {
-    std::vector<HashEntry> table;
-    size_t size;
-    int collisions = 0;
+// Убирает строку row из узла key; узел без строк удаляется из дерева
+// (CLRS, с перевязкой преемника, а не копированием его данных).
+// Память узла остаётся в пуле до следующего alloc.
+template<typename Key>
+bool eraseRBT(RBTreeT<Key>& t, std::type_identity_t<Key> key, RowId row) {
+    auto& p = t.pool;
+    NodeId z = t.root;
+    while (z != NIL && !(key == p[z].key)) z = key < p[z].key ? p[z].left : p[z].right;
+    if (z == NIL) return false;
+    auto& values = p[z].values;
+    auto it = std::find(values.begin(), values.end(), row);
+    if (it == values.end()) return false;
+    *it = values.back();
+    values.pop_back();
+    if (!values.empty()) return true;
+
+    Color removed = p[z].color;
+    NodeId x, xParent;
+    if (p[z].left == NIL) {
+        x = p[z].right;
+        xParent = p[z].parent;
+        transplantRBT(t, z, x);
+    }
+    else if (p[z].right == NIL) {
+        x = p[z].left;
+        xParent = p[z].parent;
+        transplantRBT(t, z, x);
+    }
+    else {
+        NodeId y = p[z].right;
+        while (p[y].left != NIL) y = p[y].left;
+        removed = p[y].color;
+        x = p[y].right;
+        if (p[y].parent == z) xParent = y;
+        else {
+            xParent = p[y].parent;
+            transplantRBT(t, y, x);
+            p[y].right = p[z].right;
+            p[p[y].right].parent = y;
+        }
+        transplantRBT(t, z, y);
+        p[y].left = p[z].left;
+        p[p[y].left].parent = y;
+        p[y].color = p[z].color;
+    }
+    if (removed == BLACK) fixErase(t, x, xParent);
+    p[z].left = p[z].right = p[z].parent = NIL;
+    p.free(z);
+    return true;
+}
 
-    HashTable(size_t s) : size(s), table(s) {}
+// Выделит ли insertRBT(t, key, row) память: новый узел или рост values
+template<typename Key>
+bool insertReallocatesRBT(const RBTreeT<Key>& t, std::type_identity_t<Key> key) {
+    NodeId node = t.root;
+    while (node != NIL && !(key == t.pool[node].key)) {
+        node = key < t.pool[node].key ? t.pool[node].left : t.pool[node].right;
+    }
+    if (node == NIL) return t.pool.allocReallocates();
+    return t.pool[node].values.size() == t.pool[node].values.capacity();
+}
 
-    // Простая хеш-функция
-    size_t hash(const std::string& key) {
-        unsigned long hash = 5381;
-        for (char c : key) {
-            hash = ((hash << 5) + hash) + c;
+// Пакетный поиск: до BATCH_GROUP спусков идут по уровням вперемешку,
+// узел следующего уровня подгружается, пока обрабатываются остальные
+void searchManyRBT(const RBTree& t, std::span<const std::string_view> keys, BatchResult& out) {
+    out.clear();
+    NodeId cur[BATCH_GROUP];
+    bool done[BATCH_GROUP];
+    for (size_t base = 0; base < keys.size(); base += BATCH_GROUP) {
+        size_t g = std::min(BATCH_GROUP, keys.size() - base);
+        size_t active = 0;
+        // Найденный узел остаётся в cur[i], ненайденный ключ даёт NIL
+        for (size_t i = 0; i < g; ++i) {
+            cur[i] = t.root;
+            done[i] = false;
+            if (cur[i] != NIL) active++;
+        }
+        while (active > 0) {
+            for (size_t i = 0; i < g; ++i) {
+                if (done[i] || cur[i] == NIL) continue;
+                const RBNode& n = t.pool[cur[i]];
+                int cmp = keys[base + i].compare(n.key);
+                if (cmp == 0) {
+                    done[i] = true;
+                    active--;
+                    continue;
+                }
+                cur[i] = cmp < 0 ? n.left : n.right;
+                if (cur[i] == NIL) active--;
+                else __builtin_prefetch(&t.pool[cur[i]]);
+            }
+        }
+        for (size_t i = 0; i < g; ++i) {
+            if (cur[i] == NIL) out.add(nullptr, 0);
+            else out.add(t.pool[cur[i]].values.data(), t.pool[cur[i]].values.size());
         }
-        return hash % size;
     }
+}
+
+// === Статический индекс: отсортированный массив в порядке Eytzinger ===
+// Уникальные ключи лежат в порядке обхода в ширину неявного дерева:
+// потомки узла k — 2k и 2k+1. Верхние уровни всех поисков делят одни
+// и те же кеш-линии, а спуск не зависит от результата сравнения.
+struct EytzingerIndex {
+    std::vector<std::string_view> keys;  // keys[0] не используется
+    std::vector<uint32_t> first, count;  // диапазон в rows для keys[k]
+    std::vector<RowId> rows;             // номера строк, сгруппированные по ключу
 
-    void insert(const Data& d) {
-        size_t idx = hash(d.key);
-        size_t original_idx = idx;
-        int steps = 0;
+    void build(const ApartmentTable& table) {
+        rows.resize(table.size());
+        for (RowId row = 0; row < rows.size(); ++row) rows[row] = row;
+        std::stable_sort(rows.begin(), rows.end(), [&](RowId a, RowId b) {
+            return table.key(a) < table.key(b);
+        });
 
-        while (table[idx].occupied) {
-            if (table[idx].data.key == d.key) break; // не нужно дублировать одинаковые ключи
-            idx = (idx + 1) % size;
-            steps++;
-            if (idx == original_idx) return; // таблица заполнена
+        // Границы групп одинаковых ключей в отсортированном rows
+        std::vector<uint32_t> groups;
+        for (uint32_t i = 0; i < rows.size(); ++i) {
+            if (i == 0 || table.key(rows[i]) != table.key(rows[i - 1])) groups.push_back(i);
         }
+        groups.push_back(static_cast<uint32_t>(rows.size()));
 
-        if (steps > 0) collisions++;
-        table[idx].data = d;
-        table[idx].occupied = true;
+        size_t n = groups.size() - 1;
+        keys.assign(n + 1, std::string_view());
+        first.assign(n + 1, 0);
+        count.assign(n + 1, 0);
+        size_t next = 0;
+        fill(table, groups, next, 1);
     }
 
-    std::vector<Data> search(const std::string& key) {
-        size_t idx = hash(key);
-        size_t original_idx = idx;
+    std::span<const RowId> search(std::string_view key) const {
+        size_t k = lowerBound(key);
+        if (k == 0 || keys[k] != key) return {};
+        return std::span<const RowId>(rows.data() + first[k], count[k]);
+    }
 
-        while (table[idx].occupied) {
-            if (table[idx].data.key == key) return {table[idx].data};
-            idx = (idx + 1) % size;
-            if (idx == original_idx) break;
+    // Позиция первого ключа >= key или 0, если такого нет
+    size_t lowerBound(std::string_view key) const {
+        size_t n = keys.size() - 1;
+        size_t k = 1;
+        while (k <= n) {
+            // keys[4k..4k+3] — внуки узла k, 4 string_view по 16 байт в одной
+            // кеш-линии. Подгружаются только заголовки string_view; байты
+            // ФИО, которые читает сравнение, лежат в арене и не подгружаются.
+            __builtin_prefetch(keys.data() + 4 * k);
+            k = 2 * k + (keys[k] < key);
         }
-        return {};
+        // Убираем хвост из "правых" шагов и последний "левый"
+        k >>= __builtin_ffsll(~k);
+        return k;
     }
-};
 
-// === Загрузка данных ===
-std::vector<Data> loadDataset(const std::string& filename) {
-    std::ifstream file(filename);
-    std::vector<Data> result;
-    std::string line;
-    while (std::getline(file, line)) {
-        std::stringstream ss(line);
-        std::string token;
-        std::vector<std::string> tokens;
-        while (std::getline(ss, token, ',')) tokens.push_back(token);
-        if (tokens.size() >= 5) {
-            result.push_back({tokens[4], rand()});
+    // Пакетный поиск: спуски группы идут по уровням вперемешку
+    void searchMany(std::span<const std::string_view> query, BatchResult& out) const {
+        out.clear();
+        size_t n = keys.size() - 1;
+        size_t k[BATCH_GROUP];
+        for (size_t base = 0; base < query.size(); base += BATCH_GROUP) {
+            size_t g = std::min(BATCH_GROUP, query.size() - base);
+            for (size_t i = 0; i < g; ++i) k[i] = 1;
+            for (bool active = n > 0; active;) {
+                active = false;
+                for (size_t i = 0; i < g; ++i) {
+                    if (k[i] > n) continue;
+                    k[i] = 2 * k[i] + (keys[k[i]] < query[base + i]);
+                    __builtin_prefetch(keys.data() + 4 * k[i]);
+                    active |= k[i] <= n;
+                }
+            }
+            for (size_t i = 0; i < g; ++i) {
+                size_t pos = k[i] >> __builtin_ffsll(~k[i]);
+                if (pos == 0 || keys[pos] != query[base + i]) out.add(nullptr, 0);
+                else out.add(rows.data() + first[pos], count[pos]);
+            }
         }
     }
-    return result;
-}
 
-// === Измерение времени ===
-template<typename Func>
-long long measureTime(Func f) {
-    auto start = std::chrono::high_resolution_clock::now();
-    f();
-    auto end = std::chrono::high_resolution_clock::now();
-    return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    size_t memoryBytes() const {
+        return keys.capacity() * sizeof(std::string_view) +
+               (first.capacity() + count.capacity()) * sizeof(uint32_t) +
+               rows.capacity() * sizeof(RowId);
+    }
+
+private:
+    // Обход неявного дерева в симметричном порядке раздаёт ключи по возрастанию
+    void fill(const ApartmentTable& table, const std::vector<uint32_t>& groups, size_t& next, size_t k) {
+        if (k >= keys.size()) return;
+        fill(table, groups, next, 2 * k);
+        keys[k] = table.key(rows[groups[next]]);
+        first[k] = groups[next];
+        count[k] = groups[next + 1] - groups[next];
+        next++;
+        fill(table, groups, next, 2 * k + 1);
+    }
+};
+
+// === B+-дерево с узлами размером в кеш-линии ===
+// Во внутренних узлах и листьях рядом лежат первые 8 байт каждого ключа
+// (big-endian, поэтому сравнение чисел совпадает с лексикографическим).
+// Полный ключ читается, только когда префиксы равны. Листья связаны
+// в список для упорядоченного обхода диапазонов.
+const int BPLUS_ORDER = 8; // ключей в узле: префиксы занимают одну кеш-линию
+
+inline uint64_t keyPrefix(std::string_view key) {
+    uint64_t v = 0;
+    std::memcpy(&v, key.data(), std::min<size_t>(key.size(), sizeof(v)));
+    return __builtin_bswap64(v);
 }
 
-int main() {
-    std::ofstream out("results.csv");
-    out << "Size,Linear,BST,RBT,Hash,Multimap,Collisions\n";
+struct alignas(64) BPlusNode {
+    uint64_t prefix[BPLUS_ORDER];
+    uint32_t keyRef[BPLUS_ORDER];        // индекс в BPlusTree::keys
+    NodeId child[BPLUS_ORDER + 1];       // только во внутренних узлах
+    NodeId next = NIL;                   // следующий лист
+    uint16_t count = 0;
+    bool leaf = true;
+};
 
-    std::vector<int> sizes = {1000, 5000, 10000, 50000, 100000, 200000, 250000, 300000, 400000, 500000};
-    int repeats = 10;
+struct BPlusTree {
+    NodePool<BPlusNode> pool;
+    NodeId root = NIL;
+    std::vector<std::string_view> keys;     // уникальные ключи
+    std::vector<std::vector<RowId>> values; // строки для keys[i]
 
-    for (int size : sizes) {
-        std::string filename = "apartments_" + std::to_string(size) + ".txt";
-        auto data = loadDataset(filename);
+    // <0, 0, >0: key меньше, равен или больше i-го ключа узла
+    int compare(const BPlusNode& n, int i, uint64_t prefix, std::string_view key) const {
+        if (prefix != n.prefix[i]) return prefix < n.prefix[i] ? -1 : 1;
+        return key.compare(keys[n.keyRef[i]]);
+    }
 
-        if (data.empty()) {
-            std::cerr << "[ERROR] Dataset " << filename << " is empty or unreadable.\n";
-            continue;
-        }
+    // Первый ключ узла, не меньший key
+    int lowerBound(const BPlusNode& n, uint64_t prefix, std::string_view key) const {
+        int i = 0;
+        while (i < n.count && compare(n, i, prefix, key) > 0) ++i;
+        return i;
+    }
 
-        long long totalLinear = 0, totalBST = 0, totalRBT = 0, totalHash = 0, totalMM = 0;
-        int totalCollisions = 0;
+    // Номер поддерева внутреннего узла, где может лежать key
+    int childIndex(const BPlusNode& n, uint64_t prefix, std::string_view key) const {
+        int i = 0;
+        while (i < n.count && compare(n, i, prefix, key) >= 0) ++i;
+        return i;
+    }
 
-        for (int rep = 0; rep < repeats; ++rep) {
-            std::string targetKey = data[rand() % data.size()].key;
+    size_t memoryBytes() const {
+        size_t bytes = pool.bytes() + keys.capacity() * sizeof(std::string_view) +
+                       values.capacity() * sizeof(std::vector<RowId>);
+        for (const auto& v : values) bytes += v.capacity() * sizeof(RowId);
+        return bytes;
+    }
+};
 
-            totalLinear += measureTime([&]() {
-                linearSearch(data, targetKey);
-            });
+// Результат разделения узла: разделитель и новый правый узел
+struct BPlusSplit {
+    uint64_t prefix;
+    uint32_t keyRef;
+    NodeId right;
+};
 
-            BSTNode* root = nullptr;
-            for (const auto& d : data) insertBST(root, d);
-            totalBST += measureTime([&]() {
-                std::vector<Data> res;
-                searchBST(root, targetKey, res);
-            });
+bool insertBPlus(BPlusTree& t, NodeId node, uint64_t prefix, std::string_view key, RowId row, BPlusSplit& split) {
+    uint64_t prefixes[BPLUS_ORDER + 1];
+    uint32_t refs[BPLUS_ORDER + 1];
+    NodeId children[BPLUS_ORDER + 2];
+    int count;
 
-            rbRoot = nullptr;
-            for (const auto& d : data) insertRBT(rbRoot, d);
-            totalRBT += measureTime([&]() {
-                searchRBT(rbRoot, targetKey);
-            });
+    if (t.pool[node].leaf) {
+        BPlusNode& n = t.pool[node];
+        int i = t.lowerBound(n, prefix, key);
+        if (i < n.count && n.prefix[i] == prefix && t.keys[n.keyRef[i]] == key) {
+            t.values[n.keyRef[i]].push_back(row);
+            return false;
+        }
+        uint32_t ref = static_cast<uint32_t>(t.keys.size());
+        t.keys.push_back(key);
+        t.values.push_back({row});
+        if (n.count < BPLUS_ORDER) {
+            for (int j = n.count; j > i; --j) {
+                n.prefix[j] = n.prefix[j - 1];
+                n.keyRef[j] = n.keyRef[j - 1];
+            }
+            n.prefix[i] = prefix;
+            n.keyRef[i] = ref;
+            n.count++;
+            return false;
+        }
+        // Лист полон: собираем BPLUS_ORDER + 1 ключей и делим пополам
+        count = 0;
+        for (int j = 0; j <= n.count; ++j) {
+            if (j == i) {
+                prefixes[count] = prefix;
+                refs[count++] = ref;
+            }
+            if (j < n.count) {
+                prefixes[count] = n.prefix[j];
+                refs[count++] = n.keyRef[j];
+            }
+        }
+        NodeId right = t.pool.alloc();
+        BPlusNode& l = t.pool[node];
+        BPlusNode& r = t.pool[right];
+        int half = count / 2;
+        l.count = half;
+        r.count = count - half;
+        for (int j = 0; j < r.count; ++j) {
+            r.prefix[j] = prefixes[half + j];
+            r.keyRef[j] = refs[half + j];
+        }
+        for (int j = 0; j < half; ++j) {
+            l.prefix[j] = prefixes[j];
+            l.keyRef[j] = refs[j];
+        }
+        r.next = l.next;
+        l.next = right;
+        split = {r.prefix[0], r.keyRef[0], right};
+        return true;
+    }
 
-            size_t tableSize = size * 2;
-            HashTable ht(tableSize);
-            for (const auto& d : data) ht.insert(d);
-            totalCollisions += ht.collisions;
-            totalHash += measureTime([&]() {
-                ht.search(targetKey);
-            });
+    int c = t.childIndex(t.pool[node], prefix, key);
+    BPlusSplit childSplit;
+    if (!insertBPlus(t, t.pool[node].child[c], prefix, key, row, childSplit)) return false;
 
-            std::multimap<std::string, Data> mm;
-            for (const auto& d : data) mm.insert({d.key, d});
-            totalMM += measureTime([&]() {
-                auto range = mm.equal_range(targetKey);
-                for (auto it = range.first; it != range.second; ++it) {};
-            });
+    BPlusNode& n = t.pool[node];
+    if (n.count < BPLUS_ORDER) {
+        for (int j = n.count; j > c; --j) {
+            n.prefix[j] = n.prefix[j - 1];
+            n.keyRef[j] = n.keyRef[j - 1];
+            n.child[j + 1] = n.child[j];
+        }
+        n.prefix[c] = childSplit.prefix;
+        n.keyRef[c] = childSplit.keyRef;
+        n.child[c + 1] = childSplit.right;
+        n.count++;
+        return false;
+    }
+    // Внутренний узел полон: средний разделитель уходит наверх
+    count = 0;
+    children[0] = n.child[0];
+    for (int j = 0; j <= n.count; ++j) {
+        if (j == c) {
+            prefixes[count] = childSplit.prefix;
+            refs[count] = childSplit.keyRef;
+            children[++count] = childSplit.right;
         }
+        if (j < n.count) {
+            prefixes[count] = n.prefix[j];
+            refs[count] = n.keyRef[j];
+            children[++count] = n.child[j + 1];
+        }
+    }
+    NodeId right = t.pool.alloc();
+    BPlusNode& l = t.pool[node];
+    BPlusNode& r = t.pool[right];
+    r.leaf = false;
+    int half = count / 2;
+    l.count = half;
+    for (int j = 0; j < half; ++j) {
+        l.prefix[j] = prefixes[j];
+        l.keyRef[j] = refs[j];
+        l.child[j] = children[j];
+    }
+    l.child[half] = children[half];
+    r.count = count - half - 1;
+    for (int j = 0; j < r.count; ++j) {
+        r.prefix[j] = prefixes[half + 1 + j];
+        r.keyRef[j] = refs[half + 1 + j];
+        r.child[j] = children[half + 1 + j];
+    }
+    r.child[r.count] = children[count];
+    split = {prefixes[half], refs[half], right};
+    return true;
+}
+
+void insertBPlus(BPlusTree& t, std::string_view key, RowId row) {
+    if (t.root == NIL) t.root = t.pool.alloc();
+    BPlusSplit split;
+    if (!insertBPlus(t, t.root, keyPrefix(key), key, row, split)) return;
+    NodeId newRoot = t.pool.alloc();
+    BPlusNode& r = t.pool[newRoot];
+    r.leaf = false;
+    r.count = 1;
+    r.prefix[0] = split.prefix;
+    r.keyRef[0] = split.keyRef;
+    r.child[0] = t.root;
+    r.child[1] = split.right;
+    t.root = newRoot;
+}
+
+// Лист и позиция первого ключа, не меньшего key
+std::pair<NodeId, int> lowerBoundBPlus(const BPlusTree& t, std::string_view key) {
+    if (t.root == NIL) return {NIL, 0};
+    uint64_t prefix = keyPrefix(key);
+    NodeId node = t.root;
+    while (!t.pool[node].leaf) {
+        const BPlusNode& n = t.pool[node];
+        node = n.child[t.childIndex(n, prefix, key)];
+    }
+    return {node, t.lowerBound(t.pool[node], prefix, key)};
+}
+
+std::span<const RowId> searchBPlus(const BPlusTree& t, std::string_view key) {
+    auto [node, i] = lowerBoundBPlus(t, key);
+    if (node == NIL || i >= t.pool[node].count) return {};
+    uint32_t ref = t.pool[node].keyRef[i];
+    if (t.keys[ref] != key) return {};
+    return t.values[ref];
+}
 
-        out << size << "," << (totalLinear / repeats) << "," << (totalBST / repeats) << ","
-            << (totalRBT / repeats) << "," << (totalHash / repeats) << ","
-            << (totalMM / repeats) << "," << (totalCollisions / repeats) << "\n";
+// Обходит ключи от from по возрастанию по цепочке листьев,
+// пока f(key, rows) возвращает true
+template<typename Func>
+void scanBPlus(const BPlusTree& t, std::string_view from, Func f) {
+    auto [node, i] = lowerBoundBPlus(t, from);
+    while (node != NIL) {
+        const BPlusNode& n = t.pool[node];
+        for (; i < n.count; ++i) {
+            uint32_t ref = n.keyRef[i];
+            if (!f(t.keys[ref], t.values[ref])) return;
+        }
+        node = n.next;
+        i = 0;
+    }
+}
+
+// === Политики индексов ===
+// Параметры шаблонов индексов: чем хешировать ключ, как сравнивать
+// ключи и откуда брать память. Политики — структуры со статическими
+// функциями, поэтому компилятор встраивает их в циклы поиска.
+
+// Хеш из раздела "Хеш-функция"
+struct WyHash {
+    static constexpr const char* name = "wyhash";
+    static uint64_t hash(std::string_view key) { return hashKey(key); }
+};
+
+// Побайтовый djb2: h * 33 + c
+struct Djb2Hash {
+    static constexpr const char* name = "djb2";
+    static uint64_t hash(std::string_view key) {
+        uint64_t h = 5381;
+        for (unsigned char c : key) h = h * 33 + c;
+        return h;
+    }
+};
+
+// CRC32C (полином Кастаньоли). С SSE4.2 — инструкция crc32 по 8 байт,
+// иначе таблица на байт. 32 бита растягиваются умножением на нечётную
+// константу: младшие биты, по которым выбирается слот, остаются
+// взаимно однозначными.
+const std::array<uint32_t, 256> crc32cTable = []() {
+    std::array<uint32_t, 256> t{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) c = c & 1 ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+        t[i] = c;
+    }
+    return t;
+}();
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) inline uint32_t crc32cHardware(std::string_view key) {
+    uint64_t crc = ~0u;
+    const char* p = key.data();
+    size_t n = key.size();
+    for (; n >= 8; n -= 8, p += 8) crc = _mm_crc32_u64(crc, read64(p));
+    uint32_t c = static_cast<uint32_t>(crc);
+    for (; n > 0; --n, ++p) c = _mm_crc32_u8(c, static_cast<uint8_t>(*p));
+    return ~c;
+}
+#endif
+
+inline uint32_t crc32cSoftware(std::string_view key) {
+    uint32_t c = ~0u;
+    for (unsigned char b : key) c = crc32cTable[(c ^ b) & 0xFF] ^ (c >> 8);
+    return ~c;
+}
+
+struct Crc32cHash {
+    static constexpr const char* name = "crc32c";
+    static uint64_t hash(std::string_view key) {
+#if defined(__x86_64__)
+        static const bool hardware = __builtin_cpu_supports("sse4.2");
+        uint32_t crc = hardware ? crc32cHardware(key) : crc32cSoftware(key);
+#else
+        uint32_t crc = crc32cSoftware(key);
+#endif
+        return (uint64_t(crc) << 32 | crc) * 0x9E3779B97F4A7C15ull;
+    }
+};
+
+// Сравнение ФИО целиком
+struct LexCompare {
+    static constexpr const char* name = "lex";
+    using Key = std::string_view;
+    static Key make(std::string_view key) { return key; }
+    static bool less(const Key& a, const Key& b) { return a < b; }
+    static bool equal(const Key& a, const Key& b) { return a == b; }
+};
+
+// Сначала 8-байтовые префиксы, как в B+-дереве, строки — только при
+// равных префиксах
+struct PrefixCompare {
+    static constexpr const char* name = "prefix";
+    struct Key {
+        uint64_t prefix;
+        std::string_view key;
+    };
+    static Key make(std::string_view key) { return {keyPrefix(key), key}; }
+    static bool less(const Key& a, const Key& b) {
+        return a.prefix != b.prefix ? a.prefix < b.prefix : a.key < b.key;
+    }
+    static bool equal(const Key& a, const Key& b) { return a.prefix == b.prefix && a.key == b.key; }
+};
+
+// Аллокатор с выравниванием блоков по кеш-линии
+template<typename T>
+struct CacheLineAllocator {
+    using value_type = T;
+    static constexpr std::align_val_t alignment{64};
+
+    CacheLineAllocator() = default;
+    template<typename U>
+    CacheLineAllocator(const CacheLineAllocator<U>&) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), alignment)); }
+    void deallocate(T* p, size_t) { ::operator delete(p, alignment); }
+
+    template<typename U>
+    bool operator==(const CacheLineAllocator<U>&) const { return true; }
+};
+
+// === Хеш-таблица с открытой адресацией ===
+
+// Слот хранит один уникальный ключ: его хеш, строку-образец для
+// сравнения и диапазон [first, first + count) в общем массиве postings
+struct HashSlot {
+    uint64_t hash = 0;
+    RowId keyRow = 0;
+    uint32_t first = 0;
+    uint32_t count = 0;
+    uint32_t dist = 0; // длина пробы + 1, 0 — слот пуст
+};
+
+// Robin Hood: при вставке "бедный" ключ (дальше от своего места)
+// вытесняет "богатый", поэтому поиск отсутствующего ключа
+// заканчивается, как только встречен слот с меньшей длиной пробы
+//
+// Hash — политика хеширования (см. "Политики индексов"), Alloc —
+// аллокатор для слотов и postings.
+template<typename Hash = WyHash, typename Alloc = std::allocator<void>>
+struct HashTableT {
+    template<typename T>
+    using Vector = std::vector<T, typename std::allocator_traits<Alloc>::template rebind_alloc<T>>;
+
+    const ApartmentTable& rows;
+    Vector<HashSlot> table;
+    Vector<RowId> postings;
+    size_t mask = 0;
+    size_t keys = 0;
+    int collisions = 0;     // уникальные ключи, не попавшие в свой слот
+    uint32_t maxProbe = 0;  // наибольшая длина пробы среди ключей
+    size_t garbage = 0;     // ячейки postings, оставшиеся от перенесённых и удалённых строк
+
+    explicit HashTableT(const ApartmentTable& r, size_t minCapacity = 16) : rows(r) {
+        size_t capacity = 16;
+        while (capacity < minCapacity) capacity <<= 1;
+        table.resize(capacity);
+        mask = capacity - 1;
+    }
+
+    // Средняя длина пробы при успешном поиске
+    double avgProbe() const {
+        if (keys == 0) return 0;
+        size_t total = 0;
+        for (const auto& slot : table) total += slot.dist;
+        return double(total) / keys;
+    }
+
+    // Строит таблицу по всем строкам
+    void build() {
+        buildFrom(rows.size(), [](size_t i) { return static_cast<RowId>(i); });
+    }
+
+    // Строит таблицу только по строкам subset (возрастающим)
+    void build(std::span<const RowId> subset) {
+        buildFrom(subset.size(), [&](size_t i) { return subset[i]; });
+    }
+
+    const HashSlot* find(std::string_view key) const {
+        uint64_t h = Hash::hash(key);
+        size_t idx = h & mask;
+        for (uint32_t dist = 1; table[idx].dist >= dist; ++dist) {
+            countProbe();
+            if (table[idx].hash == h && keysEqual(rows.key(table[idx].keyRow), key)) return &table[idx];
+            idx = (idx + 1) & mask;
+        }
+        return nullptr;
+    }
+
+    HashSlot* find(std::string_view key) {
+        return const_cast<HashSlot*>(std::as_const(*this).find(key));
+    }
+
+    std::span<const RowId> search(std::string_view key) const {
+        LookupScope scope(STATS_HASH);
+        const HashSlot* slot = find(key);
+        if (!slot) return {};
+        return std::span<const RowId>(postings.data() + slot->first, slot->count);
+    }
+
+    // Пакетный поиск в три прохода по группе ключей: хеши и подгрузка
+    // слотов, выбор слота по хешу и подгрузка ключа и строк, сверка ключа
+    void searchMany(std::span<const std::string_view> keys, BatchResult& out) {
+        out.clear();
+        uint64_t hashes[BATCH_GROUP];
+        HashSlot* found[BATCH_GROUP];
+        for (size_t base = 0; base < keys.size(); base += BATCH_GROUP) {
+            size_t g = std::min(BATCH_GROUP, keys.size() - base);
+            for (size_t i = 0; i < g; ++i) {
+                hashes[i] = Hash::hash(keys[base + i]);
+                __builtin_prefetch(&table[hashes[i] & mask]);
+            }
+            for (size_t i = 0; i < g; ++i) {
+                found[i] = probe(hashes[i]);
+                if (found[i]) {
+                    __builtin_prefetch(&rows.keyOffset[found[i]->keyRow]);
+                    __builtin_prefetch(&postings[found[i]->first]);
+                }
+            }
+            for (size_t i = 0; i < g; ++i) {
+                HashSlot* slot = found[i];
+                // Совпал только 64-битный хеш — ищем обычным путём
+                if (slot && rows.key(slot->keyRow) != keys[base + i]) slot = find(keys[base + i]);
+                if (slot) out.add(postings.data() + slot->first, slot->count);
+                else out.add(nullptr, 0);
+            }
+        }
+    }
+
+    // Первый слот с таким хешем (без сверки ключа)
+    HashSlot* probe(uint64_t h) {
+        size_t idx = h & mask;
+        for (uint32_t dist = 1; table[idx].dist >= dist; ++dist) {
+            if (table[idx].hash == h) return &table[idx];
+            idx = (idx + 1) & mask;
+        }
+        return nullptr;
+    }
+
+    // Добавляет строку row, её ФИО уже лежит в rows. Диапазон ключа
+    // растёт на месте, только если он последний в postings, иначе
+    // переносится в конец, а прежнее место становится мусором.
+    void insert(RowId row) {
+        HashSlot* slot = findOrInsert(row);
+        if (slot->count == 0) slot->first = static_cast<uint32_t>(postings.size());
+        else if (slot->first + slot->count != postings.size()) {
+            uint32_t first = static_cast<uint32_t>(postings.size());
+            postings.resize(first + slot->count);
+            std::copy_n(postings.begin() + slot->first, slot->count, postings.begin() + first);
+            garbage += slot->count;
+            slot->first = first;
+        }
+        postings.push_back(row);
+        slot->count++;
+    }
+
+    // Выделит ли insert строки с ФИО key память: рост таблицы или postings
+    bool insertReallocates(std::string_view key) {
+        HashSlot* slot = find(key);
+        if (!slot) return (keys + 1) * 8 > table.size() * 7 || postings.size() == postings.capacity();
+        size_t need = slot->first + slot->count == postings.size() ? 1 : slot->count + 1;
+        return postings.size() + need > postings.capacity();
+    }
+
+    // Убирает строку row. Ключ без строк удаляется сдвигом назад:
+    // следующие слоты с пробой больше 1 переезжают на шаг ближе к своему
+    // месту, так что надгробия в таблице не нужны.
+    bool erase(RowId row) {
+        HashSlot* slot = find(rows.key(row));
+        if (!slot) return false;
+        RowId* first = postings.data() + slot->first;
+        RowId* last = first + slot->count;
+        RowId* it = std::find(first, last, row);
+        if (it == last) return false;
+        *it = *(last - 1);
+        slot->count--;
+        if (slot->first + slot->count + 1 == postings.size()) postings.pop_back();
+        else garbage++;
+        if (slot->count == 0) eraseSlot(slot - table.data());
+        return true;
+    }
+
+    // Собирает диапазоны ключей подряд, выкидывая мусор
+    void compact() {
+        Vector<RowId> packed;
+        packed.reserve(postings.capacity());
+        for (auto& slot : table) {
+            if (slot.dist == 0) continue;
+            uint32_t first = static_cast<uint32_t>(packed.size());
+            packed.insert(packed.end(), postings.begin() + slot.first, postings.begin() + slot.first + slot.count);
+            slot.first = first;
+        }
+        postings.swap(packed);
+        garbage = 0;
+    }
+
+    size_t memoryBytes() const {
+        return table.capacity() * sizeof(HashSlot) + postings.capacity() * sizeof(RowId);
+    }
+
+private:
+    void eraseSlot(size_t idx) {
+        size_t next = (idx + 1) & mask;
+        while (table[next].dist > 1) {
+            table[idx] = table[next];
+            table[idx].dist--;
+            idx = next;
+            next = (next + 1) & mask;
+        }
+        table[idx] = HashSlot();
+        keys--;
+    }
+
+    // Сначала считаем строки на ключ, потом раскладываем номера строк
+    // в postings по порядку
+    template<typename RowAt>
+    void buildFrom(size_t n, RowAt rowAt) {
+        for (size_t i = 0; i < n; ++i) {
+            HashSlot* slot = findOrInsert(rowAt(i));
+            slot->count++;
+        }
+        uint32_t offset = 0;
+        for (auto& slot : table) {
+            offset += slot.count;
+            slot.first = offset; // конец диапазона, заполняем с конца
+        }
+        postings.resize(offset);
+        for (size_t i = n; i-- > 0;) {
+            RowId row = rowAt(i);
+            HashSlot* slot = find(rows.key(row));
+            postings[--slot->first] = row;
+        }
+        collisions = 0;
+        maxProbe = 0;
+        for (const auto& slot : table) {
+            if (slot.dist > 1) collisions++;
+            maxProbe = std::max(maxProbe, slot.dist);
+        }
+    }
+
+    HashSlot* findOrInsert(RowId row) {
+        if (HashSlot* slot = find(rows.key(row))) return slot;
+        if ((keys + 1) * 8 > table.size() * 7) grow();
+        HashSlot entry;
+        entry.hash = Hash::hash(rows.key(row));
+        entry.keyRow = row;
+        keys++;
+        return place(entry);
+    }
+
+    // Вставка ключа, которого точно нет в таблице. Возвращает слот,
+    // куда в итоге попал именно этот ключ
+    HashSlot* place(HashSlot entry) {
+        HashSlot* result = nullptr;
+        size_t idx = entry.hash & mask;
+        entry.dist = 1;
+        while (true) {
+            HashSlot& slot = table[idx];
+            if (slot.dist == 0) {
+                slot = entry;
+                return result ? result : &slot;
+            }
+            if (slot.dist < entry.dist) {
+                std::swap(slot, entry);
+                if (!result) result = &slot;
+            }
+            idx = (idx + 1) & mask;
+            entry.dist++;
+        }
+    }
+
+    void grow() {
+        Vector<HashSlot> old(table.size() * 2);
+        old.swap(table);
+        mask = table.size() - 1;
+        for (const auto& slot : old) {
+            if (slot.dist) place(slot);
+        }
+    }
+};
+
+using HashTable = HashTableT<>;
+
+// === Словарь ключей ===
+// Каждое уникальное ФИО получает плотный 32-битный номер. Номера
+// раздаются в порядке сортировки строк, поэтому сравнение номеров
+// совпадает со сравнением самих ФИО и упорядоченные индексы остаются
+// упорядоченными. Строки лежат подряд в одной арене, поиск номера по
+// строке — открытая адресация по хешу с 32-битной меткой в слоте.
+struct KeyDictionary {
+    std::string arena;
+    std::vector<uint32_t> offset{0}; // ФИО с номером id: arena[offset[id], offset[id + 1])
+    std::vector<uint64_t> slots;     // метка << 32 | id, пустой слот — NO_KEY
+    size_t mask = 0;
+
+    size_t size() const { return offset.size() - 1; }
+
+    std::string_view key(KeyId id) const {
+        return std::string_view(arena.data() + offset[id], offset[id + 1] - offset[id]);
+    }
+
+    // Номер ФИО или NO_KEY, если такого ключа в данных нет
+    KeyId find(std::string_view key) const {
+        uint64_t h = hashKey(key);
+        uint32_t tag = static_cast<uint32_t>(h >> 32);
+        for (size_t idx = h & mask;; idx = (idx + 1) & mask) {
+            uint64_t slot = slots[idx];
+            KeyId id = static_cast<KeyId>(slot);
+            if (id == NO_KEY) return NO_KEY;
+            if (static_cast<uint32_t>(slot >> 32) == tag && this->key(id) == key) return id;
+        }
+    }
+
+    size_t memoryBytes() const {
+        return arena.capacity() + offset.capacity() * sizeof(uint32_t) + slots.capacity() * sizeof(uint64_t);
+    }
+};
+
+// Строит словарь по таблице; rowKeys[row] — номер ФИО строки row
+KeyDictionary buildKeyDictionary(const ApartmentTable& table, std::vector<KeyId>& rowKeys) {
+    std::vector<RowId> order(table.size());
+    for (RowId row = 0; row < order.size(); ++row) order[row] = row;
+    std::sort(order.begin(), order.end(), [&](RowId a, RowId b) { return table.key(a) < table.key(b); });
+
+    KeyDictionary dict;
+    rowKeys.assign(table.size(), NO_KEY);
+    KeyId id = NO_KEY;
+    for (size_t i = 0; i < order.size(); ++i) {
+        std::string_view key = table.key(order[i]);
+        if (i == 0 || key != table.key(order[i - 1])) {
+            dict.arena.append(key);
+            dict.offset.push_back(static_cast<uint32_t>(dict.arena.size()));
+            id = static_cast<KeyId>(dict.size() - 1);
+        }
+        rowKeys[order[i]] = id;
+    }
+    dict.arena.shrink_to_fit();
+    dict.offset.shrink_to_fit();
+
+    // Загрузка не выше 1/2: промах заканчивается на первом пустом слоте
+    size_t capacity = 16;
+    while (capacity < 2 * dict.size()) capacity <<= 1;
+    dict.slots.assign(capacity, NO_KEY);
+    dict.mask = capacity - 1;
+    for (KeyId k = 0; k < dict.size(); ++k) {
+        uint64_t h = hashKey(dict.key(k));
+        size_t idx = h & dict.mask;
+        while (static_cast<KeyId>(dict.slots[idx]) != NO_KEY) idx = (idx + 1) & dict.mask;
+        dict.slots[idx] = (h >> 32) << 32 | k;
+    }
+    return dict;
+}
+
+// Строки по номеру ФИО: rows[first[id], first[id + 1]). Номера плотные,
+// поэтому после интернирования это замена хеш-таблицы без проб.
+struct KeyPostings {
+    std::vector<uint32_t> first;
+    std::vector<RowId> rows;
+
+    void build(const std::vector<KeyId>& rowKeys, size_t keyCount) {
+        first.assign(keyCount + 1, 0);
+        for (KeyId id : rowKeys) first[id + 1]++;
+        for (size_t k = 0; k < keyCount; ++k) first[k + 1] += first[k];
+        rows.resize(rowKeys.size());
+        std::vector<uint32_t> pos(first.begin(), first.end() - 1);
+        for (RowId row = 0; row < rowKeys.size(); ++row) rows[pos[rowKeys[row]]++] = row;
+    }
+
+    std::span<const RowId> search(KeyId id) const {
+        if (id == NO_KEY) return {};
+        return std::span<const RowId>(rows.data() + first[id], first[id + 1] - first[id]);
+    }
+};
+
+// === Префиксный поиск: сжатое префиксное дерево ===
+// Radix-дерево по байтам UTF-8 над отсортированным словарём ключей.
+// Поддерево узла — непрерывный диапазон номеров [lo, hi), а строки
+// в KeyPostings сгруппированы по номерам, поэтому ответ на префиксный
+// запрос — один срез postings без обхода поддерева. Метка ребра не
+// хранится: это байты key(lo) с глубины родителя до depth узла.
+struct RadixNode {
+    KeyId lo, hi;         // ключи поддерева
+    uint32_t firstChild;  // дети лежат подряд в nodes
+    uint16_t childCount;
+    uint16_t depth;       // длина общего префикса ключей поддерева
+};
+
+struct PrefixIndex {
+    const KeyDictionary& dict;
+    const KeyPostings& postings;
+    std::vector<RadixNode> nodes;  // nodes[0] — корень
+    std::vector<uint8_t> leads;    // первый байт метки узла, рядом для детей одного родителя
+
+    PrefixIndex(const KeyDictionary& d, const KeyPostings& p) : dict(d), postings(p) {}
+
+    // Обход в ширину кладёт детей каждого узла подряд
+    void build() {
+        nodes.clear();
+        leads.clear();
+        if (dict.size() == 0) return;
+        KeyId n = static_cast<KeyId>(dict.size());
+        nodes.push_back({0, n, 0, 0, commonPrefix(0, n - 1)});
+        leads.push_back(0);
+        for (size_t idx = 0; idx < nodes.size(); ++idx) {
+            RadixNode node = nodes[idx];
+            nodes[idx].firstChild = static_cast<uint32_t>(nodes.size());
+            KeyId i = node.lo;
+            if (dict.key(i).size() == node.depth) ++i; // ключ, равный префиксу узла
+            while (i < node.hi) {
+                uint8_t b = dict.key(i)[node.depth];
+                KeyId j = i + 1;
+                while (j < node.hi && uint8_t(dict.key(j)[node.depth]) == b) ++j;
+                nodes.push_back({i, j, 0, 0, commonPrefix(i, j - 1)});
+                leads.push_back(b);
+                i = j;
+            }
+            nodes[idx].childCount = static_cast<uint16_t>(nodes.size() - nodes[idx].firstChild);
+        }
+        nodes.shrink_to_fit();
+        leads.shrink_to_fit();
+    }
+
+    // Диапазон номеров ключей, начинающихся с prefix; пустой, если таких нет
+    std::pair<KeyId, KeyId> range(std::string_view prefix) const {
+        if (nodes.empty()) return {0, 0};
+        const RadixNode* node = &nodes[0];
+        size_t pos = 0;
+        for (;;) {
+            // Сверяем метку узла с запросом
+            size_t end = std::min<size_t>(node->depth, prefix.size());
+            std::string_view label = dict.key(node->lo);
+            if (std::memcmp(label.data() + pos, prefix.data() + pos, end - pos) != 0) return {0, 0};
+            if (end == prefix.size()) return {node->lo, node->hi};
+            pos = end;
+
+            const uint8_t* first = leads.data() + node->firstChild;
+            const uint8_t* last = first + node->childCount;
+            const uint8_t* child = std::find(first, last, uint8_t(prefix[pos]));
+            if (child == last) return {0, 0};
+            node = &nodes[child - leads.data()];
+        }
+    }
+
+    // Строки всех ключей с префиксом prefix, без копирования
+    std::span<const RowId> rows(std::string_view prefix) const {
+        auto [lo, hi] = range(prefix);
+        if (lo == hi) return {};
+        const uint32_t* first = postings.first.data();
+        return std::span<const RowId>(postings.rows.data() + first[lo], first[hi] - first[lo]);
+    }
+
+    // Первые k ключей с префиксом prefix в порядке сортировки
+    void complete(std::string_view prefix, size_t k, std::vector<std::string_view>& out) const {
+        out.clear();
+        auto [lo, hi] = range(prefix);
+        for (KeyId id = lo; id < hi && out.size() < k; ++id) out.push_back(dict.key(id));
+    }
+
+    size_t memoryBytes() const {
+        return nodes.capacity() * sizeof(RadixNode) + leads.capacity();
+    }
+
+private:
+    uint16_t commonPrefix(KeyId a, KeyId b) const {
+        std::string_view x = dict.key(a), y = dict.key(b);
+        size_t n = std::min(x.size(), y.size());
+        return static_cast<uint16_t>(std::mismatch(x.begin(), x.begin() + n, y.begin()).first - x.begin());
+    }
+};
+
+// Первые chars символов UTF-8 строки
+std::string_view utf8Prefix(std::string_view s, size_t chars) {
+    size_t i = 0;
+    for (; i < s.size() && chars > 0; --chars) {
+        ++i;
+        while (i < s.size() && (uint8_t(s[i]) & 0xC0) == 0x80) ++i;
+    }
+    return s.substr(0, i);
+}
+
+// === Вторичные индексы по числовым полям ===
+// Диапазонный запрос по площади, цене, комнатам и этажу; границы
+// включительные, по умолчанию условие поля всегда истинно
+struct RangeQuery {
+    uint16_t areaMin = 0, areaMax = UINT16_MAX;
+    float priceMin = -INFINITY, priceMax = INFINITY;
+    uint8_t roomsMin = 0, roomsMax = UINT8_MAX;
+    uint8_t floorMin = 0, floorMax = UINT8_MAX;
+
+    bool matches(const ApartmentTable& t, RowId row) const {
+        return t.area[row] >= areaMin && t.area[row] <= areaMax &&
+               t.price[row] >= priceMin && t.price[row] <= priceMax &&
+               t.rooms[row] >= roomsMin && t.rooms[row] <= roomsMax &&
+               t.floor[row] >= floorMin && t.floor[row] <= floorMax;
+    }
+};
+
+// Полный проход по таблице, как linearSearch
+std::vector<RowId> rangeScan(const ApartmentTable& table, const RangeQuery& q) {
+    std::vector<RowId> results;
+    for (RowId row = 0; row < table.size(); ++row) {
+        if (q.matches(table, row)) results.push_back(row);
+    }
+    return results;
+}
+
+// Столбец, отсортированный по значению: строки с value в [lo, hi] —
+// непрерывный отрезок rows, его границы — два двоичных поиска
+template<typename T>
+struct SortedColumn {
+    std::vector<T> values;
+    std::vector<RowId> rows;
+
+    void build(const std::vector<T>& column) {
+        rows.resize(column.size());
+        for (RowId row = 0; row < rows.size(); ++row) rows[row] = row;
+        std::stable_sort(rows.begin(), rows.end(), [&](RowId a, RowId b) { return column[a] < column[b]; });
+        values.resize(column.size());
+        for (size_t i = 0; i < rows.size(); ++i) values[i] = column[rows[i]];
+    }
+
+    std::pair<size_t, size_t> range(T lo, T hi) const {
+        if (hi < lo) return {0, 0};
+        size_t first = std::lower_bound(values.begin(), values.end(), lo) - values.begin();
+        size_t last = std::upper_bound(values.begin(), values.end(), hi) - values.begin();
+        return {first, last};
+    }
+
+    size_t memoryBytes() const {
+        return values.capacity() * sizeof(T) + rows.capacity() * sizeof(RowId);
+    }
+};
+
+// Битовые карты для столбца с малым числом значений (комнаты, этаж):
+// бит row в bitmaps[v] установлен, если в строке значение v
+struct ValueBitmaps {
+    std::vector<std::vector<uint64_t>> bitmaps;
+    std::vector<uint32_t> counts;
+    size_t words = 0;
+
+    void build(const std::vector<uint8_t>& column) {
+        words = (column.size() + 63) / 64;
+        uint8_t maxValue = column.empty() ? 0 : *std::max_element(column.begin(), column.end());
+        bitmaps.assign(maxValue + 1, std::vector<uint64_t>(words, 0));
+        counts.assign(maxValue + 1, 0);
+        for (RowId row = 0; row < column.size(); ++row) {
+            bitmaps[column[row]][row / 64] |= uint64_t(1) << (row % 64);
+            counts[column[row]]++;
+        }
+    }
+
+    size_t count(uint8_t lo, uint8_t hi) const {
+        size_t n = 0;
+        for (size_t v = lo; v <= hi && v < counts.size(); ++v) n += counts[v];
+        return n;
+    }
+
+    // out &= (объединение карт значений из [lo, hi])
+    void intersect(uint8_t lo, uint8_t hi, std::vector<uint64_t>& out, std::vector<uint64_t>& scratch) const {
+        scratch.assign(words, 0);
+        for (size_t v = lo; v <= hi && v < bitmaps.size(); ++v) {
+            const uint64_t* bits = bitmaps[v].data();
+            for (size_t w = 0; w < words; ++w) scratch[w] |= bits[w];
+        }
+        for (size_t w = 0; w < words; ++w) out[w] &= scratch[w];
+    }
+
+    size_t memoryBytes() const {
+        return bitmaps.size() * words * sizeof(uint64_t) + counts.capacity() * sizeof(uint32_t);
+    }
+};
+
+// Планировщик выбирает самое избирательное условие по точным размерам:
+// если это отрезок площади или цены и он короткий, проходим его строки
+// и проверяем остальные условия по столбцам. Иначе пересекаем битовые
+// карты комнат и этажа пословно и проверяем только оставшиеся строки.
+// Порядок строк в ответе не гарантирован.
+struct AttributeIndex {
+    const ApartmentTable& table;
+    SortedColumn<uint16_t> area;
+    SortedColumn<float> price;
+    ValueBitmaps rooms, floor;
+
+    explicit AttributeIndex(const ApartmentTable& t) : table(t) {}
+
+    void build() {
+        area.build(table.area);
+        price.build(table.price);
+        rooms.build(table.rooms);
+        floor.build(table.floor);
+    }
+
+    void search(const RangeQuery& q, std::vector<RowId>& out) const {
+        out.clear();
+        auto areaRange = area.range(q.areaMin, q.areaMax);
+        auto priceRange = price.range(q.priceMin, q.priceMax);
+        size_t areaCount = areaRange.second - areaRange.first;
+        size_t priceCount = priceRange.second - priceRange.first;
+        size_t bitmapCount = std::min(rooms.count(q.roomsMin, q.roomsMax), floor.count(q.floorMin, q.floorMax));
+
+        // Проход по отрезку дешевле пословного пересечения, пока строк
+        // в нём меньше, чем слов в карте, умноженных на небольшой запас
+        size_t sortedCount = std::min(areaCount, priceCount);
+        if (sortedCount <= bitmapCount || sortedCount < 4 * rooms.words) {
+            bool byArea = areaCount <= priceCount;
+            auto [first, last] = byArea ? areaRange : priceRange;
+            const std::vector<RowId>& rows = byArea ? area.rows : price.rows;
+            for (size_t i = first; i < last; ++i) {
+                if (q.matches(table, rows[i])) out.push_back(rows[i]);
+            }
+            return;
+        }
+
+        thread_local std::vector<uint64_t> bits, scratch;
+        bits.assign(rooms.words, ~uint64_t(0));
+        rooms.intersect(q.roomsMin, q.roomsMax, bits, scratch);
+        floor.intersect(q.floorMin, q.floorMax, bits, scratch);
+        for (size_t w = 0; w < bits.size(); ++w) {
+            for (uint64_t word = bits[w]; word; word &= word - 1) {
+                RowId row = static_cast<RowId>(w * 64 + __builtin_ctzll(word));
+                if (q.matches(table, row)) out.push_back(row);
+            }
+        }
+    }
+
+    // Смешанный запрос: строки одного ФИО из индекса по имени,
+    // отфильтрованные по числовым условиям
+    void filter(std::span<const RowId> nameRows, const RangeQuery& q, std::vector<RowId>& out) const {
+        out.clear();
+        for (RowId row : nameRows) {
+            if (q.matches(table, row)) out.push_back(row);
+        }
+    }
+
+    size_t memoryBytes() const {
+        return area.memoryBytes() + price.memoryBytes() + rooms.memoryBytes() + floor.memoryBytes();
+    }
+};
+
+// === Кеш горячих ключей ===
+// Ограниченный кеш ответов поиска по ФИО перед любым индексом. Вытеснение
+// S3-FIFO: новый ключ попадает в малую очередь (десятая часть бюджета);
+// вытесняемый из неё ключ, к которому за это время обращались, переходит
+// в основную очередь, остальные уходят в очередь призраков, где хранится
+// только хеш. Ключ, найденный среди призраков, сразу идёт в основную
+// очередь. Основная очередь работает как CLOCK: ключ с ненулевым счётчиком
+// обращений возвращается в хвост со счётчиком на единицу меньше.
+//
+// Стоимость записи — байты ключа и строк плюс постоянная часть на
+// служебные структуры. Запись дороже малой очереди не принимается:
+// длинный список дубликатов вытеснил бы десятки горячих ключей.
+//
+// Кеш разбит на сегменты по хешу, у каждого свой mutex. Чтобы поиск,
+// начатый до обновления, не положил в кеш устаревший ответ, у сегмента
+// есть эпоха: invalidate её увеличивает, а insert с эпохой, которую
+// вернул промах lookup до поиска по индексу, отвергается.
+const size_t CACHE_SHARDS = 16;
+const size_t CACHE_ENTRY_OVERHEAD = 96; // запись, узел словаря и места в очередях
+const uint8_t CACHE_MAX_FREQ = 3;
+
+struct CacheStats {
+    uint64_t hits = 0, misses = 0, inserts = 0, evictions = 0;
+    uint64_t rejected = 0;      // не приняты из-за стоимости
+    uint64_t stale = 0;         // отвергнуты из-за обновления во время поиска
+    uint64_t invalidations = 0;
+    size_t bytes = 0, entries = 0;
+
+    double hitRatio() const { return hits + misses ? double(hits) / (hits + misses) : 0; }
+};
+
+struct ResultCache {
+    struct Entry {
+        uint64_t hash = 0;
+        std::string key;
+        std::vector<RowId> rows;
+        size_t cost = 0;
+        uint8_t freq = 0;
+        bool inMain = false;
+        bool live = false;
+    };
+
+    // Вытесненная или сброшенная запись остаётся в очереди мёртвой,
+    // номер освобождается, когда очередь до неё дойдёт
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        uint64_t epoch = 0;
+        std::vector<Entry> entries;
+        std::vector<uint32_t> freeIds;
+        std::unordered_map<uint64_t, uint32_t> index;
+        std::deque<uint32_t> small, main;
+        std::deque<uint64_t> ghost;
+        std::unordered_set<uint64_t> ghostSet;
+        size_t smallBytes = 0, mainBytes = 0;
+        CacheStats stats;
+    };
+
+    size_t shardBudget, smallBudget;
+    std::array<Shard, CACHE_SHARDS> shards;
+
+    explicit ResultCache(size_t budgetBytes)
+        : shardBudget(budgetBytes / CACHE_SHARDS), smallBudget(budgetBytes / CACHE_SHARDS / 10) {}
+
+    // Копирует закешированный ответ в out; при промахе возвращает false
+    // и эпоху сегмента для последующего insert
+    bool lookup(std::string_view key, std::vector<RowId>& out, uint64_t& epoch) {
+        uint64_t h = hashKey(key);
+        Shard& s = shardOf(h);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.index.find(h);
+        if (it == s.index.end() || s.entries[it->second].key != key) {
+            s.stats.misses++;
+            epoch = s.epoch;
+            return false;
+        }
+        Entry& e = s.entries[it->second];
+        out.assign(e.rows.begin(), e.rows.end());
+        e.freq = std::min<uint8_t>(e.freq + 1, CACHE_MAX_FREQ);
+        s.stats.hits++;
+        return true;
+    }
+
+    void insert(std::string_view key, std::span<const RowId> rows, uint64_t epoch) {
+        uint64_t h = hashKey(key);
+        Shard& s = shardOf(h);
+        size_t cost = key.size() + rows.size() * sizeof(RowId) + CACHE_ENTRY_OVERHEAD;
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (s.epoch != epoch) {
+            s.stats.stale++;
+            return;
+        }
+        if (cost > smallBudget) {
+            s.stats.rejected++;
+            return;
+        }
+        auto it = s.index.find(h);
+        if (it != s.index.end()) {
+            if (s.entries[it->second].key == key) return; // другой поток успел раньше
+            drop(s, it->second);
+        }
+        bool toMain = s.ghostSet.erase(h) > 0;
+        while (s.smallBytes + s.mainBytes + cost > shardBudget && evictOne(s)) {}
+
+        uint32_t id;
+        if (!s.freeIds.empty()) {
+            id = s.freeIds.back();
+            s.freeIds.pop_back();
+        }
+        else {
+            id = static_cast<uint32_t>(s.entries.size());
+            s.entries.emplace_back();
+        }
+        Entry& e = s.entries[id];
+        e.hash = h;
+        e.key.assign(key);
+        e.rows.assign(rows.begin(), rows.end());
+        e.cost = cost;
+        e.freq = 0;
+        e.inMain = toMain;
+        e.live = true;
+        s.index.emplace(h, id);
+        (toMain ? s.main : s.small).push_back(id);
+        (toMain ? s.mainBytes : s.smallBytes) += cost;
+        s.stats.inserts++;
+    }
+
+    // Сбрасывает ответ для key; вызывается после изменения индекса
+    void invalidate(std::string_view key) {
+        uint64_t h = hashKey(key);
+        Shard& s = shardOf(h);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.epoch++;
+        s.stats.invalidations++;
+        auto it = s.index.find(h);
+        if (it != s.index.end()) drop(s, it->second);
+    }
+
+    CacheStats stats() {
+        CacheStats total;
+        for (Shard& s : shards) {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            total.hits += s.stats.hits;
+            total.misses += s.stats.misses;
+            total.inserts += s.stats.inserts;
+            total.evictions += s.stats.evictions;
+            total.rejected += s.stats.rejected;
+            total.stale += s.stats.stale;
+            total.invalidations += s.stats.invalidations;
+            total.bytes += s.smallBytes + s.mainBytes;
+            total.entries += s.index.size();
+        }
+        return total;
+    }
+
+private:
+    Shard& shardOf(uint64_t h) { return shards[h >> 60]; }
+
+    // Убирает живую запись из словаря и бюджета, место в очереди остаётся
+    void drop(Shard& s, uint32_t id) {
+        Entry& e = s.entries[id];
+        (e.inMain ? s.mainBytes : s.smallBytes) -= e.cost;
+        s.index.erase(e.hash);
+        e.live = false;
+        std::string().swap(e.key);
+        std::vector<RowId>().swap(e.rows);
+    }
+
+    // Один шаг вытеснения; false — очереди пусты
+    bool evictOne(Shard& s) {
+        bool fromSmall = !s.small.empty() && (s.smallBytes > smallBudget || s.main.empty());
+        std::deque<uint32_t>& queue = fromSmall ? s.small : s.main;
+        if (queue.empty()) return false;
+        uint32_t id = queue.front();
+        queue.pop_front();
+        Entry& e = s.entries[id];
+        if (!e.live) {
+            s.freeIds.push_back(id);
+            return true;
+        }
+        if (fromSmall && e.freq > 0) {
+            e.freq = 0;
+            e.inMain = true;
+            s.smallBytes -= e.cost;
+            s.mainBytes += e.cost;
+            s.main.push_back(id);
+            return true;
+        }
+        if (!fromSmall && e.freq > 0) {
+            e.freq--;
+            s.main.push_back(id);
+            return true;
+        }
+        if (fromSmall && s.ghostSet.insert(e.hash).second) {
+            s.ghost.push_back(e.hash);
+            // Призраков не больше, чем живых записей: старше них ключ
+            // из малой очереди уже не отличить от нового
+            while (s.ghost.size() > std::max<size_t>(s.index.size(), 16)) {
+                s.ghostSet.erase(s.ghost.front());
+                s.ghost.pop_front();
+            }
+        }
+        drop(s, id);
+        s.freeIds.push_back(id);
+        s.stats.evictions++;
+        return true;
+    }
+};
+
+// === Обновления при конкурентных читателях ===
+// Реестр с изменяемыми индексами: строки таблицы только дописываются,
+// удалённая строка помечается в live и остаётся в арене, поэтому ссылки
+// индексов на её ФИО не протухают. Изменение ФИО — удаление строки и
+// новая строка с тем же содержимым под новым номером.
+//
+// Читатели не берут блокировок. Писатели (по одному, под mutex) делают
+// seq нечётным на время записи; читатель запоминает чётный seq, ищет
+// и повторяет поиск, если seq за это время изменился (seqlock). Поиск
+// может увидеть полуизменённое дерево, поэтому спуск ограничен по
+// глубине, а результат отбрасывается проверкой seq. Память на месте
+// при этом не освобождается и не перевыделяется: если запись должна
+// что-то выделить (рост вектора, переиспользование узла, сборка мусора
+// postings), писатель сначала ждёт, пока все объявленные в своих слотах
+// читатели выйдут, а новые при нечётном seq не входят.
+const size_t MAX_READERS = 64;
+
+struct alignas(64) ReaderSlot {
+    std::atomic<uint32_t> active{0};
+};
+
+struct Registry {
+    ApartmentTable table;
+    std::vector<uint8_t> live;
+    RBTree tree;
+    HashTable hash{table};
+
+    std::mutex writeMutex;
+    std::atomic<uint64_t> seq{0};
+    ReaderSlot readers[MAX_READERS];
+    std::atomic<size_t> readerCount{0};
+    std::atomic<uint64_t> retries{0};   // повторённые поиски читателей
+    std::atomic<uint64_t> graceWaits{0}; // записи, ждавшие выхода читателей
+    ResultCache* cache = nullptr;        // сбрасывается после каждой записи
+
+    // Таблица переносится целиком, индексы строятся заново. Запас
+    // spareRows строк резервируется сразу, чтобы рост векторов (и
+    // ожидание читателей) был редким; позже резервировать нельзя —
+    // ключи дерева указывают в арену ФИО.
+    explicit Registry(ApartmentTable data, size_t spareRows = 0) : table(std::move(data)) {
+        size_t rows = table.size() + spareRows;
+        size_t avgName = table.empty() ? 0 : table.names.size() / table.size();
+        table.reserve(rows, table.names.size() + spareRows * avgName);
+        live.reserve(rows);
+        live.assign(table.size(), 1);
+        hash.postings.reserve(rows);
+        for (RowId row = 0; row < table.size(); ++row) insertRBT(tree, table.key(row), row);
+        hash.build();
+    }
+
+    // Слот читателя на поток. Общий слот двух потоков скрыл бы от
+    // писателя активного читателя, поэтому сверх MAX_READERS — ошибка.
+    ReaderSlot& registerReader() {
+        size_t index = readerCount.fetch_add(1);
+        if (index >= MAX_READERS) throw std::length_error("Registry: more than MAX_READERS reader threads");
+        return readers[index];
+    }
+
+    // Строки с ФИО key по хеш-индексу. Под seqlock ответ нельзя отдать
+    // видом на индекс, поэтому он копируется в буфер вызывающего.
+    size_t search(ReaderSlot& slot, std::string_view key, std::vector<RowId>& out) {
+        return read(slot, [&]() -> std::optional<size_t> {
+            out.clear();
+            // hash.find, но поля слота могут быть разорваны писателем
+            // (сдвиг при удалении, Robin Hood), поэтому номер строки и
+            // диапазон postings сверяются с размерами до разыменования
+            uint64_t h = WyHash::hash(key);
+            size_t idx = h & hash.mask;
+            for (uint32_t dist = 1; dist <= hash.table.size() && hash.table[idx].dist >= dist; ++dist) {
+                HashSlot found = hash.table[idx];
+                if (found.hash == h) {
+                    if (size_t(found.keyRow) + 1 >= table.keyOffset.size() ||
+                        size_t(found.first) + found.count > hash.postings.size()) {
+                        return std::nullopt;
+                    }
+                    if (table.key(found.keyRow) == key) {
+                        const RowId* first = hash.postings.data() + found.first;
+                        out.assign(first, first + found.count);
+                        break;
+                    }
+                }
+                idx = (idx + 1) & hash.mask;
+            }
+            return out.size();
+        });
+    }
+
+    // search через кеш, если он подключён
+    size_t searchCached(ReaderSlot& slot, std::string_view key, std::vector<RowId>& out) {
+        if (!cache) return search(slot, key, out);
+        uint64_t epoch;
+        if (cache->lookup(key, out, epoch)) return out.size();
+        search(slot, key, out);
+        cache->insert(key, out, epoch);
+        return out.size();
+    }
+
+    // Строки с ФИО key по дереву
+    size_t searchOrdered(ReaderSlot& slot, std::string_view key, std::vector<RowId>& out) {
+        return read(slot, [&]() -> std::optional<size_t> {
+            out.clear();
+            NodeId node = tree.root;
+            // Высота красно-чёрного дерева не больше 2 log2(n + 1) <= 64
+            for (int depth = 0; node != NIL && depth < 64; ++depth) {
+                // Ссылка из полуизменённого узла — повтор, а не выход за пул
+                if (node >= tree.pool.size()) return std::nullopt;
+                const RBNode& n = tree.pool[node];
+                int cmp = key.compare(n.key);
+                if (cmp == 0) {
+                    out.assign(n.values.begin(), n.values.end());
+                    break;
+                }
+                node = cmp < 0 ? n.left : n.right;
+            }
+            return out.size();
+        });
+    }
+
+    RowId insert(uint16_t apt, uint16_t area, uint8_t rooms, float price, uint8_t floor, std::string_view name) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        RowId row = insertLocked(apt, area, rooms, price, floor, name);
+        if (cache) cache->invalidate(name);
+        return row;
+    }
+
+    bool erase(RowId row) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        if (row >= live.size() || !live[row]) return false;
+        // Удаление ничего не выделяет и не освобождает
+        beginWrite(false);
+        eraseLocked(row);
+        endWrite();
+        // Удалённая строка остаётся в арене, её ФИО ещё можно читать
+        if (cache) cache->invalidate(table.key(row));
+        return true;
+    }
+
+    // Меняет ФИО строки; возвращает номер новой версии строки или NIL
+    RowId update(RowId row, std::string_view name) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        if (row >= live.size() || !live[row]) return NIL;
+        std::string copy(name); // name может указывать в арену таблицы
+        // Последняя строка ФИО освобождает узел, и вставка может взять его же
+        NodeId node = tree.root;
+        while (node != NIL && tree.pool[node].key != table.key(row)) {
+            node = table.key(row) < tree.pool[node].key ? tree.pool[node].left : tree.pool[node].right;
+        }
+        bool freesNode = node != NIL && tree.pool[node].values.size() == 1;
+        beginWrite(freesNode);
+        eraseLocked(row);
+        // Удаление меняет мусор postings и может включить их сборку в
+        // appendLocked, поэтому остальное решается уже после него
+        if (!freesNode && insertReallocates(copy)) waitForReaders();
+        RowId next = appendLocked(table.apartment[row], table.area[row], table.rooms[row], table.price[row],
+                                  table.floor[row], copy);
+        endWrite();
+        if (cache) {
+            cache->invalidate(table.key(row));
+            cache->invalidate(copy);
+        }
+        return next;
+    }
+
+private:
+    // lookup возвращает пустой optional, если заметил разорванные
+    // записью данные; такой поиск повторяется, как и при смене seq
+    template<typename Func>
+    auto read(ReaderSlot& slot, Func lookup) -> typename decltype(lookup())::value_type {
+        for (;;) {
+            uint64_t before = seq.load(std::memory_order_acquire);
+            if (before & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+            slot.active.store(1, std::memory_order_seq_cst);
+            // Писатель мог войти между чтением seq и объявлением
+            if (seq.load(std::memory_order_seq_cst) != before) {
+                slot.active.store(0, std::memory_order_release);
+                continue;
+            }
+            auto result = lookup();
+            std::atomic_thread_fence(std::memory_order_acquire);
+            bool consistent = result && seq.load(std::memory_order_relaxed) == before;
+            slot.active.store(0, std::memory_order_release);
+            if (consistent) return *result;
+            retries.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void beginWrite(bool reallocates) {
+        seq.fetch_add(1, std::memory_order_seq_cst);
+        if (reallocates) waitForReaders();
+    }
+
+    // Ждёт выхода объявленных читателей; вызывается при нечётном seq,
+    // так что новые читатели не входят
+    void waitForReaders() {
+        graceWaits.fetch_add(1, std::memory_order_relaxed);
+        size_t n = std::min(readerCount.load(), MAX_READERS);
+        for (size_t i = 0; i < n; ++i) {
+            while (readers[i].active.load(std::memory_order_seq_cst)) std::this_thread::yield();
+        }
+    }
+
+    void endWrite() { seq.fetch_add(1, std::memory_order_release); }
+
+    RowId insertLocked(uint16_t apt, uint16_t area, uint8_t rooms, float price, uint8_t floor,
+                       std::string_view name) {
+        beginWrite(insertReallocates(name));
+        RowId row = appendLocked(apt, area, rooms, price, floor, name);
+        endWrite();
+        return row;
+    }
+
+    // Выделит ли вставка строки с ФИО name память где-нибудь; сборка
+    // мусора postings тоже перевыделяет их. appendLocked собирает мусор
+    // только при true, поэтому проверять нужно прямо перед ним.
+    bool insertReallocates(std::string_view name) {
+        return hash.garbage * 2 > hash.postings.size() || table.appendReallocates(name.size()) ||
+               live.size() == live.capacity() || insertReallocatesRBT(tree, name) || hash.insertReallocates(name);
+    }
+
+    RowId appendLocked(uint16_t apt, uint16_t area, uint8_t rooms, float price, uint8_t floor,
+                       std::string_view name) {
+        if (hash.garbage * 2 > hash.postings.size()) hash.compact();
+        uintptr_t oldArena = reinterpret_cast<uintptr_t>(table.names.data());
+        RowId row = table.append(apt, area, rooms, price, floor, name);
+        // Ключи дерева — окна в арену ФИО; после её переезда сдвигаем их
+        if (reinterpret_cast<uintptr_t>(table.names.data()) != oldArena) {
+            for (RBNode& n : tree.pool.nodes) {
+                size_t offset = reinterpret_cast<uintptr_t>(n.key.data()) - oldArena;
+                n.key = std::string_view(table.names.data() + offset, n.key.size());
+            }
+        }
+        live.push_back(1);
+        insertRBT(tree, table.key(row), row);
+        hash.insert(row);
+        return row;
+    }
+
+    void eraseLocked(RowId row) {
+        eraseRBT(tree, table.key(row), row);
+        hash.erase(row);
+        live[row] = 0;
+    }
+};
+
+// === Обобщённые индексы ===
+// Общий интерфейс индекса по ФИО: сборка по таблице, поиск строк,
+// равный диапазон как у std::multimap::equal_range и занятая память.
+// Бенчмарк перебирает конфигурации из списка типов, каждая собирается
+// как отдельная специализация со встроенными политиками.
+template<typename T>
+concept NameIndex = requires(T& index, const T& c, const ApartmentTable& table, std::string_view key) {
+    { T::name() } -> std::convertible_to<std::string>;
+    index.build(table);
+    { c.find(key) } -> std::same_as<std::span<const RowId>>;
+    { c.equalRange(key) } -> std::same_as<std::pair<const RowId*, const RowId*>>;
+    { c.memoryBytes() } -> std::convertible_to<size_t>;
+};
+
+// equalRange через find для индексов, где строки ключа лежат подряд
+template<typename Derived>
+struct ContiguousRows {
+    std::pair<const RowId*, const RowId*> equalRange(std::string_view key) const {
+        std::span<const RowId> rows = static_cast<const Derived&>(*this).find(key);
+        return {rows.data(), rows.data() + rows.size()};
+    }
+};
+
+template<typename Hash, typename Alloc = std::allocator<void>>
+struct HashIndex : ContiguousRows<HashIndex<Hash, Alloc>> {
+    std::optional<HashTableT<Hash, Alloc>> table;
+
+    static std::string name() {
+        bool aligned = !std::is_same_v<Alloc, std::allocator<void>>;
+        return std::string("Hash<") + Hash::name + (aligned ? ",cacheline>" : ">");
+    }
+
+    void build(const ApartmentTable& rows) {
+        table.emplace(rows);
+        table->build();
+    }
+
+    std::span<const RowId> find(std::string_view key) const { return table->search(key); }
+
+    size_t memoryBytes() const {
+        return table->table.capacity() * sizeof(HashSlot) + table->postings.capacity() * sizeof(RowId);
+    }
+};
+
+// Отсортированные уникальные ключи и строки, сгруппированные по ключу
+template<typename Compare, typename Alloc = std::allocator<void>>
+struct SortedIndex : ContiguousRows<SortedIndex<Compare, Alloc>> {
+    template<typename T>
+    using Vector = std::vector<T, typename std::allocator_traits<Alloc>::template rebind_alloc<T>>;
+
+    Vector<typename Compare::Key> keys;
+    Vector<uint32_t> first; // строки keys[i]: rows[first[i], first[i + 1])
+    Vector<RowId> rows;
+
+    static std::string name() { return std::string("Sorted<") + Compare::name + ">"; }
+
+    void build(const ApartmentTable& table) {
+        rows.resize(table.size());
+        for (RowId row = 0; row < rows.size(); ++row) rows[row] = row;
+        std::stable_sort(rows.begin(), rows.end(), [&](RowId a, RowId b) {
+            return Compare::less(Compare::make(table.key(a)), Compare::make(table.key(b)));
+        });
+        keys.clear();
+        first.clear();
+        for (uint32_t i = 0; i < rows.size(); ++i) {
+            auto key = Compare::make(table.key(rows[i]));
+            if (keys.empty() || !Compare::equal(keys.back(), key)) {
+                keys.push_back(key);
+                first.push_back(i);
+            }
+        }
+        first.push_back(static_cast<uint32_t>(rows.size()));
+    }
+
+    std::span<const RowId> find(std::string_view key) const {
+        auto k = Compare::make(key);
+        auto it = std::lower_bound(keys.begin(), keys.end(), k, Compare::less);
+        if (it == keys.end() || !Compare::equal(*it, k)) return {};
+        size_t i = it - keys.begin();
+        return std::span<const RowId>(rows.data() + first[i], first[i + 1] - first[i]);
+    }
+
+    size_t memoryBytes() const {
+        return keys.capacity() * sizeof(typename Compare::Key) + first.capacity() * sizeof(uint32_t) +
+               rows.capacity() * sizeof(RowId);
+    }
+};
+
+struct RBTIndex : ContiguousRows<RBTIndex> {
+    RBTree tree;
+
+    static std::string name() { return "RBT"; }
+
+    void build(const ApartmentTable& table) {
+        for (RowId row = 0; row < table.size(); ++row) insertRBT(tree, table.key(row), row);
+    }
+
+    std::span<const RowId> find(std::string_view key) const { return searchRBT(tree, key); }
+    size_t memoryBytes() const { return tree.memoryBytes(); }
+};
+
+struct EytzingerNameIndex : ContiguousRows<EytzingerNameIndex> {
+    EytzingerIndex index;
+
+    static std::string name() { return "Eytzinger"; }
+    void build(const ApartmentTable& table) { index.build(table); }
+    std::span<const RowId> find(std::string_view key) const { return index.search(key); }
+    size_t memoryBytes() const { return index.memoryBytes(); }
+};
+
+// Индекс с кешем ответов перед ним. Ответ копируется в буфер вызывающего:
+// запись кеша может быть вытеснена сразу после поиска.
+template<NameIndex Index>
+struct CachedIndex {
+    const Index& index;
+    ResultCache& cache;
+
+    size_t search(std::string_view key, std::vector<RowId>& out) const {
+        uint64_t epoch;
+        if (cache.lookup(key, out, epoch)) return out.size();
+        std::span<const RowId> rows = index.find(key);
+        out.assign(rows.begin(), rows.end());
+        cache.insert(key, out, epoch);
+        return out.size();
+    }
+};
+
+template<typename... Ts>
+struct TypeList {};
+
+// Вызывает f.template operator()<T>() для каждого T из списка
+template<typename... Ts, typename Func>
+void forEachType(TypeList<Ts...>, Func&& f) {
+    (f.template operator()<Ts>(), ...);
+}
+
+using IndexConfigs = TypeList<
+    HashIndex<WyHash>, HashIndex<Djb2Hash>, HashIndex<Crc32cHash>,
+    HashIndex<WyHash, CacheLineAllocator<void>>,
+    SortedIndex<LexCompare>, SortedIndex<PrefixCompare>,
+    RBTIndex, EytzingerNameIndex>;
+
+// === Пул потоков и параллельные операции ===
+struct ThreadPool {
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable ready;
+    bool stopping = false;
+
+    explicit ThreadPool(size_t threads) {
+        for (size_t i = 0; i < threads; ++i) {
+            workers.emplace_back([this]() {
+                while (true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        ready.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                        if (stopping && tasks.empty()) return;
+                        task = std::move(tasks.front());
+                        tasks.pop();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (auto& w : workers) w.join();
+    }
+
+    size_t size() const { return workers.size(); }
+
+    // Выполняет f(i) для i из [0, n) на потоках пула и ждёт завершения
+    template<typename Func>
+    void parallelFor(size_t n, Func f) {
+        std::latch done(static_cast<std::ptrdiff_t>(n));
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < n; ++i) {
+                tasks.push([&f, &done, i]() {
+                    f(i);
+                    done.count_down();
+                });
+            }
+        }
+        ready.notify_all();
+        done.wait();
+    }
+};
+
+// Границы i-й из parts частей диапазона [0, n)
+inline std::pair<size_t, size_t> partRange(size_t n, size_t parts, size_t i) {
+    return {n * i / parts, n * (i + 1) / parts};
+}
+
+// Скан по отпечаткам, разбитый на части по числу потоков.
+// Части сливаются по порядку, поэтому номера строк остаются возрастающими.
+std::vector<RowId> parallelLinearSearch(ThreadPool& pool, const ApartmentTable& table,
+                                        const std::vector<uint32_t>& prints, std::string_view key) {
+    static const FingerprintScan scan = selectFingerprintScan();
+    uint32_t print = keyFingerprint(key);
+    std::vector<std::vector<RowId>> parts(pool.size());
+    pool.parallelFor(parts.size(), [&](size_t i) {
+        auto [begin, end] = partRange(prints.size(), parts.size(), i);
+        scan(prints.data(), begin, end, print, table, key, parts[i]);
+    });
+    std::vector<RowId> results;
+    for (const auto& part : parts) results.insert(results.end(), part.begin(), part.end());
+    return results;
+}
+
+// Хеш-индекс из независимых секций: секция ключа — старшие биты хеша.
+// Секции строятся параллельно, каждая своей HashTable.
+struct PartitionedHashTable {
+    std::vector<HashTable> parts;
+    int shift = 64;
+
+    uint64_t partOf(uint64_t h) const { return shift == 64 ? 0 : h >> shift; }
+
+    void build(ThreadPool& pool, const ApartmentTable& table) {
+        size_t count = 1;
+        while (count < pool.size()) count <<= 1;
+        shift = 64 - __builtin_ctzll(count);
+        parts.clear();
+        for (size_t i = 0; i < count; ++i) parts.emplace_back(table);
+
+        // Каждый поток раскладывает свой кусок строк по секциям
+        size_t chunks = pool.size();
+        std::vector<std::vector<std::vector<RowId>>> buckets(chunks, std::vector<std::vector<RowId>>(count));
+        pool.parallelFor(chunks, [&](size_t c) {
+            auto [begin, end] = partRange(table.size(), chunks, c);
+            for (size_t row = begin; row < end; ++row) {
+                buckets[c][partOf(hashKey(table.key(row)))].push_back(static_cast<RowId>(row));
+            }
+        });
+        // Куски идут по возрастанию строк, значит и склейка упорядочена
+        pool.parallelFor(count, [&](size_t p) {
+            std::vector<RowId> rows;
+            for (size_t c = 0; c < chunks; ++c) rows.insert(rows.end(), buckets[c][p].begin(), buckets[c][p].end());
+            parts[p].build(rows);
+        });
+    }
+
+    std::span<const RowId> search(std::string_view key) {
+        return parts[partOf(hashKey(key))].search(key);
+    }
+};
+
+// Параллельная сортировка номеров строк по ключу: куски сортируются
+// на потоках, затем попарно сливаются
+std::vector<RowId> parallelSortRows(ThreadPool& pool, const ApartmentTable& table) {
+    std::vector<RowId> rows(table.size());
+    for (RowId row = 0; row < rows.size(); ++row) rows[row] = row;
+    auto less = [&](RowId a, RowId b) { return table.key(a) < table.key(b); };
+
+    size_t chunks = pool.size();
+    std::vector<size_t> bounds(chunks + 1);
+    for (size_t i = 0; i <= chunks; ++i) bounds[i] = rows.size() * i / chunks;
+    pool.parallelFor(chunks, [&](size_t i) {
+        std::stable_sort(rows.begin() + bounds[i], rows.begin() + bounds[i + 1], less);
+    });
+    for (size_t width = 1; width < chunks; width *= 2) {
+        size_t merges = (chunks + 2 * width - 1) / (2 * width);
+        pool.parallelFor(merges, [&](size_t m) {
+            size_t lo = 2 * width * m;
+            size_t mid = std::min(lo + width, chunks), hi = std::min(lo + 2 * width, chunks);
+            if (mid < hi) {
+                std::inplace_merge(rows.begin() + bounds[lo], rows.begin() + bounds[mid],
+                                   rows.begin() + bounds[hi], less);
+            }
+        });
+    }
+    return rows;
+}
+
+// Строит сбалансированное RB-дерево из отсортированных строк. Узел i —
+// i-й уникальный ключ; середина диапазона становится корнем поддерева.
+// Все пути до NIL отличаются не больше чем на один узел, поэтому узлы
+// самого нижнего неполного уровня красные, остальные чёрные.
+void bulkBuildRBT(ThreadPool& pool, RBTree& t, const ApartmentTable& table, const std::vector<RowId>& sorted) {
+    std::vector<uint32_t> groups;
+    for (uint32_t i = 0; i < sorted.size(); ++i) {
+        if (i == 0 || table.key(sorted[i]) != table.key(sorted[i - 1])) groups.push_back(i);
+    }
+    size_t n = groups.size();
+    groups.push_back(static_cast<uint32_t>(sorted.size()));
+
+    t.pool.release();
+    t.pool.reserve(n);
+    for (size_t i = 0; i < n; ++i) t.pool.alloc(table.key(sorted[groups[i]]), sorted[groups[i]]);
+    pool.parallelFor(pool.size(), [&](size_t part) {
+        auto [begin, end] = partRange(n, pool.size(), part);
+        for (size_t i = begin; i < end; ++i) {
+            t.pool[i].values.assign(sorted.begin() + groups[i], sorted.begin() + groups[i + 1]);
+        }
+    });
+
+    // Глубина (от 0) уровня, который не заполнен целиком, или -1
+    int height = 0;
+    while ((size_t(2) << height) - 1 < n) ++height;
+    int redDepth = ((size_t(2) << height) - 1 == n) ? -1 : height;
+
+    auto link = [&](auto& self, int64_t lo, int64_t hi, NodeId parent, int depth) -> NodeId {
+        if (lo > hi) return NIL;
+        NodeId mid = static_cast<NodeId>((lo + hi) / 2);
+        RBNode& node = t.pool[mid];
+        node.parent = parent;
+        node.color = depth == redDepth ? RED : BLACK;
+        node.left = self(self, lo, int64_t(mid) - 1, mid, depth + 1);
+        node.right = self(self, int64_t(mid) + 1, hi, mid, depth + 1);
+        return mid;
+    };
+    t.root = link(link, 0, int64_t(n) - 1, NIL, 0);
+}
+
+// === Загрузка данных ===
+
+// Старый загрузчик: getline + stringstream, строка на каждое поле.
+// Оставлен для сравнения в бенчмарке загрузки.
+std::vector<std::string> loadDatasetStream(const std::string& filename) {
+    std::ifstream file(filename);
+    std::vector<std::string> result;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::stringstream ss(line);
+        std::string token;
+        std::vector<std::string> tokens;
+        while (std::getline(ss, token, ',')) tokens.push_back(token);
+        if (tokens.size() >= 5) {
+            result.push_back(tokens[4]);
+        }
+    }
+    return result;
+}
+
+// Файл, отображённый в память только для чтения
+struct MappedFile {
+    const char* data = nullptr;
+    size_t size = 0;
+
+    MappedFile() = default;
+
+    explicit MappedFile(const std::string& filename, int advice = MADV_SEQUENTIAL) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                madvise(p, st.st_size, advice);
+                data = static_cast<const char*>(p);
+                size = st.st_size;
+            }
+        }
+        close(fd);
+    }
+
+    MappedFile(MappedFile&& other) noexcept : data(other.data), size(other.size) {
+        other.data = nullptr;
+        other.size = 0;
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            unmap();
+            data = other.data;
+            size = other.size;
+            other.data = nullptr;
+            other.size = 0;
+        }
+        return *this;
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() { unmap(); }
+
+    void unmap() {
+        if (data) munmap(const_cast<char*>(data), size);
+        data = nullptr;
+        size = 0;
+    }
+};
+
+// Вызывает f(pos) для каждого ',' и '\n' в буфере.
+// С SSE2 сравниваем по 16 байт за раз и обходим биты маски.
+template<typename Func>
+void scanDelimiters(const char* p, size_t n, Func f) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        unsigned mask = _mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(v, comma), _mm_cmpeq_epi8(v, newline)));
+        while (mask) {
+            f(i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        if (p[i] == ',' || p[i] == '\n') f(i);
+    }
+}
+
+// Разбирает числовое поле, пустое или битое поле даёт 0
+template<typename T>
+T parseField(const char* begin, const char* end) {
+    T value{};
+    std::from_chars(begin, end, value);
+    return value;
+}
+
+// Дописывает в таблицу строки из буфера [p, p + n). Последняя строка
+// может быть без '\n'.
+void parseRows(const char* p, size_t n, ApartmentTable& table) {
+    // Границы полей текущей строки: поле i = [begin[i], end[i])
+    size_t begin[6] = {}, end[6] = {};
+    size_t fieldStart = 0;
+    int field = 0;
+    auto endLine = [&](size_t pos) {
+        if (field < 6) end[field] = pos;
+        // Как и раньше, строка нужна хотя бы из 5 полей
+        if (field > 4 || (field == 4 && pos > fieldStart)) {
+            auto last = [&](int i) { return i <= field ? p + end[i] : p; };
+            auto first = [&](int i) { return i <= field ? p + begin[i] : p; };
+            table.apartment.push_back(parseField<uint16_t>(first(0), last(0)));
+            table.area.push_back(parseField<uint16_t>(first(1), last(1)));
+            table.rooms.push_back(parseField<uint8_t>(first(2), last(2)));
+            table.price.push_back(parseField<float>(first(3), last(3)));
+            table.floor.push_back(parseField<uint8_t>(first(5), last(5)));
+            table.names.append(p + begin[4], end[4] - begin[4]);
+            table.keyOffset.push_back(static_cast<uint32_t>(table.names.size()));
+        }
+        fieldStart = pos + 1;
+        field = 0;
+        begin[0] = fieldStart;
+    };
+    scanDelimiters(p, n, [&](size_t pos) {
+        if (p[pos] == '\n') {
+            endLine(pos);
+            return;
+        }
+        if (field < 6) end[field] = pos;
+        ++field;
+        fieldStart = pos + 1;
+        if (field < 6) begin[field] = fieldStart;
+    });
+    if (fieldStart < n) endLine(n);
+}
+
+// Загружает файл в колоночную таблицу. Файл читается через mmap,
+// ФИО копируются в арену одной строкой, после загрузки файл закрывается.
+ApartmentTable loadDataset(const std::string& filename) {
+    ApartmentTable table;
+    MappedFile file(filename);
+    if (!file.data) return table;
+    // Грубая оценка: строка ~64 байта, из них ~40 на ФИО
+    table.reserve(file.size / 48 + 1, file.size * 2 / 3);
+    parseRows(file.data, file.size, table);
+    return table;
+}
+
+// === Потоковая загрузка ===
+// Конвейер для файлов, которые не стоит держать в памяти целиком:
+// чтение -> разбор (parseThreads потоков) -> перенос в таблицу ->
+// построители индексов. Читатель берёт файл кусками по chunkBytes и
+// обрезает кусок по последнему '\n', хвост уходит в начало следующего.
+// Разборщики превращают куски в маленькие таблицы, переносчик
+// восстанавливает порядок кусков и дописывает их в общую таблицу, а
+// каждый построитель получает диапазоны новых строк через свою очередь
+// и работает одновременно с остальными стадиями.
+//
+// Все очереди ограничены. Кроме того, кусок в полёте занимает
+// 2 * chunkBytes бюджета memoryCap (сырые байты и разобранная таблица)
+// от чтения до переноса, а индексы — столько, сколько сообщают их
+// построители; когда бюджет исчерпан, читатель ждёт. Сама таблица в
+// бюджет не входит: хранить её вне памяти конвейер не умеет. Поэтому
+// бюджет выдерживается, только пока индексы в него помещаются; если
+// они одни больше бюджета, конвейер держит в полёте по одному куску,
+// а IngestReport::capMet сообщает, что бюджет превышен.
+//
+// Построители читают уже перенесённые строки общей таблицы, пока
+// переносчик дописывает следующие. Арена ФИО резервируется по размеру
+// файла и не переезжает, поэтому ключи-окна в неё (RB-дерево) остаются
+// верны. Столбцы могут расти; перед ростом переносчик ждёт, пока
+// построители доработают всё выданное, как писатель Registry ждёт читателей.
+template<typename T>
+struct BoundedQueue {
+    std::deque<T> items;
+    size_t capacity;
+    bool closed = false;
+    std::mutex mutex;
+    std::condition_variable notFull, notEmpty;
+
+    explicit BoundedQueue(size_t cap) : capacity(std::max<size_t>(cap, 1)) {}
+
+    void push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [&]() { return items.size() < capacity; });
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+    }
+
+    // Пустой optional — очередь закрыта и пуста
+    std::optional<T> pop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [&]() { return closed || !items.empty(); });
+        if (items.empty()) return std::nullopt;
+        T item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return item;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notEmpty.notify_all();
+    }
+};
+
+// Счётчик байтов в полёте и байтов, занятых индексами. Если в полёте
+// ничего нет, запрос проходит всегда, иначе кусок больше бюджета (или
+// индексы больше бюджета) остановили бы конвейер.
+struct ByteBudget {
+    size_t cap, used = 0, held = 0, peak = 0;
+    std::mutex mutex;
+    std::condition_variable released;
+
+    explicit ByteBudget(size_t c) : cap(c) {}
+
+    void acquire(size_t bytes) {
+        std::unique_lock<std::mutex> lock(mutex);
+        released.wait(lock, [&]() { return used == 0 || held + used + bytes <= cap; });
+        used += bytes;
+        peak = std::max(peak, held + used);
+    }
+
+    // Индексы выросли или сжались с before до after байт
+    void resizeHeld(size_t before, size_t after) {
+        std::lock_guard<std::mutex> lock(mutex);
+        held = held - before + after;
+        peak = std::max(peak, held + used);
+        if (after < before) released.notify_all();
+    }
+
+    void release(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        used -= bytes;
+        released.notify_all();
+    }
+};
+
+struct IngestConfig {
+    size_t chunkBytes = size_t(1) << 20;
+    size_t memoryCap = size_t(64) << 20; // байты кусков в полёте и индексов
+    size_t parseThreads = 2;
+    size_t queueDepth = 4;               // мест в каждой очереди
+};
+
+// Построитель индекса: build(first, last) получает строки [first, last)
+// общей таблицы по порядку; bytes, если задан, — память индекса, она
+// входит в бюджет
+struct IngestBuilder {
+    std::string name;
+    std::function<void(RowId first, RowId last)> build;
+    std::function<size_t()> bytes;
+};
+
+struct IngestStage {
+    std::string name;
+    size_t threads = 1;
+    long long busyNs = 0; // время работы, без ожидания очередей и бюджета
+};
+
+struct IngestReport {
+    bool ok = false;
+    size_t rows = 0, bytes = 0, chunks = 0;
+    long long wallNs = 0;
+    size_t peakBytes = 0;     // наибольшая занятость бюджета (куски и индексы)
+    bool capMet = false;      // peakBytes не превысил memoryCap
+    size_t columnGrowths = 0; // росты столбцов с ожиданием построителей
+    std::vector<IngestStage> stages;
+
+    double rowsPerSec() const { return wallNs > 0 ? rows * 1e9 / wallNs : 0; }
+
+    // Доля времени, которую потоки стадии работали
+    double utilization(const IngestStage& s) const {
+        return wallNs > 0 ? double(s.busyNs) / (double(wallNs) * s.threads) : 0;
+    }
+};
+
+// Читает до n байт, повторяя read; -1 при ошибке
+ssize_t readFull(int fd, char* p, size_t n) {
+    size_t got = 0;
+    while (got < n) {
+        ssize_t r = read(fd, p + got, n - got);
+        if (r == 0) break;
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        got += r;
+    }
+    return static_cast<ssize_t>(got);
+}
+
+// Загружает filename в пустую таблицу table и одновременно кормит
+// построителей. Построители вызываются каждый из своего потока.
+IngestReport ingestDataset(const std::string& filename, const IngestConfig& config, ApartmentTable& table,
+                           std::span<IngestBuilder> builders) {
+    using Clock = std::chrono::steady_clock;
+    auto since = [](Clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    };
+    IngestReport report;
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return report;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return report;
+    }
+    size_t fileSize = st.st_size;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    // ФИО — подстроки файла, поэтому арена размером с файл не переедет;
+    // нетронутые страницы резерва память не занимают
+    table.reserve(fileSize / 48 + 1, fileSize);
+
+    struct RawChunk {
+        uint64_t seq;
+        std::vector<char> data;
+    };
+    struct ParsedChunk {
+        uint64_t seq;
+        ApartmentTable part;
+    };
+    const size_t parseThreads = std::max<size_t>(config.parseThreads, 1);
+    const size_t charge = 2 * config.chunkBytes;
+    ByteBudget budget(config.memoryCap);
+    BoundedQueue<RawChunk> rawQueue(config.queueDepth);
+    BoundedQueue<ParsedChunk> parsedQueue(config.queueDepth);
+    std::deque<BoundedQueue<std::pair<RowId, RowId>>> rangeQueues; // deque не двигает очереди
+    for (size_t b = 0; b < builders.size(); ++b) rangeQueues.emplace_back(config.queueDepth);
+    std::atomic<long long> readNs{0}, parseNs{0}, appendNs{0};
+    std::vector<long long> buildNs(builders.size(), 0);
+    std::vector<RowId> built(builders.size(), 0);
+    std::mutex progressMutex;
+    std::condition_variable progress;
+    std::atomic<bool> readFailed{false};
+    std::atomic<size_t> parsersLeft{parseThreads};
+
+    Clock::time_point begin = Clock::now();
+    std::vector<std::thread> threads;
+    threads.emplace_back([&]() {
+        std::vector<char> carry;
+        size_t offset = 0;
+        uint64_t seq = 0;
+        for (bool eof = false; !eof;) {
+            budget.acquire(charge);
+            Clock::time_point start = Clock::now();
+            std::vector<char> data = std::move(carry);
+            carry.clear();
+            // Строка длиннее куска растит буфер до её конца; бюджет
+            // тогда превышается на длину этой строки
+            size_t target = config.chunkBytes, cut = 0;
+            for (;;) {
+                size_t have = data.size();
+                if (have < target) {
+                    data.resize(target);
+                    ssize_t n = readFull(fd, data.data() + have, target - have);
+                    if (n < 0) {
+                        readFailed = true;
+                        n = 0;
+                    }
+                    data.resize(have + n);
+                    offset += n;
+                    eof = have + n < target;
+                    if (!eof) posix_fadvise(fd, offset, config.chunkBytes * config.queueDepth, POSIX_FADV_WILLNEED);
+                }
+                auto nl = std::find(data.rbegin(), data.rend(), '\n');
+                if (nl != data.rend() || eof) {
+                    cut = nl != data.rend() ? data.rend() - nl : data.size();
+                    break;
+                }
+                target += config.chunkBytes;
+            }
+            carry.assign(data.begin() + cut, data.end());
+            data.resize(cut);
+            readNs += since(start);
+            if (data.empty()) {
+                budget.release(charge);
+                continue;
+            }
+            rawQueue.push({seq++, std::move(data)});
+        }
+        rawQueue.close();
+    });
+
+    for (size_t t = 0; t < parseThreads; ++t) {
+        threads.emplace_back([&]() {
+            while (auto raw = rawQueue.pop()) {
+                Clock::time_point start = Clock::now();
+                ParsedChunk chunk{raw->seq, ApartmentTable()};
+                chunk.part.reserve(raw->data.size() / 48 + 1, raw->data.size());
+                parseRows(raw->data.data(), raw->data.size(), chunk.part);
+                std::vector<char>().swap(raw->data);
+                parseNs += since(start);
+                parsedQueue.push(std::move(chunk));
+            }
+            if (parsersLeft.fetch_sub(1) == 1) parsedQueue.close();
+        });
+    }
+
+    threads.emplace_back([&]() {
+        std::map<uint64_t, ParsedChunk> pending; // куски, обогнавшие очередной
+        uint64_t next = 0;
+        while (auto chunk = parsedQueue.pop()) {
+            uint64_t seq = chunk->seq;
+            pending.emplace(seq, std::move(*chunk));
+            while (!pending.empty() && pending.begin()->first == next) {
+                ParsedChunk c = std::move(pending.begin()->second);
+                pending.erase(pending.begin());
+                next++;
+                Clock::time_point start = Clock::now();
+                RowId first = static_cast<RowId>(table.size());
+                size_t rows = first + c.part.size();
+                if (rows > table.apartment.capacity() || rows + 1 > table.keyOffset.capacity()) {
+                    appendNs += since(start);
+                    {
+                        std::unique_lock<std::mutex> lock(progressMutex);
+                        progress.wait(lock, [&]() {
+                            return std::all_of(built.begin(), built.end(), [&](RowId r) { return r == first; });
+                        });
+                    }
+                    start = Clock::now();
+                    table.reserve(std::max(rows, table.apartment.capacity() * 2), table.names.capacity());
+                    report.columnGrowths++;
+                }
+                table.append(c.part);
+                c.part = ApartmentTable();
+                budget.release(charge);
+                report.chunks++;
+                appendNs += since(start);
+                for (auto& q : rangeQueues) q.push({first, static_cast<RowId>(table.size())});
+            }
+        }
+        for (auto& q : rangeQueues) q.close();
+    });
+
+    for (size_t b = 0; b < builders.size(); ++b) {
+        threads.emplace_back([&, b]() {
+            size_t held = 0;
+            while (auto range = rangeQueues[b].pop()) {
+                Clock::time_point start = Clock::now();
+                builders[b].build(range->first, range->second);
+                buildNs[b] += since(start);
+                if (builders[b].bytes) {
+                    size_t bytes = builders[b].bytes();
+                    budget.resizeHeld(held, bytes);
+                    held = bytes;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(progressMutex);
+                    built[b] = range->second;
+                }
+                progress.notify_all();
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    close(fd);
+
+    report.ok = !readFailed;
+    report.wallNs = since(begin);
+    report.rows = table.size();
+    report.bytes = fileSize;
+    report.peakBytes = budget.peak;
+    report.capMet = budget.peak <= config.memoryCap;
+    report.stages.push_back({"Read", 1, readNs});
+    report.stages.push_back({"Parse", parseThreads, parseNs});
+    report.stages.push_back({"Append", 1, appendNs});
+    for (size_t b = 0; b < builders.size(); ++b) report.stages.push_back({builders[b].name, 1, buildNs[b]});
+    return report;
+}
+
+// === Бинарный снимок таблицы и индексов ===
+// Файл: заголовок, таблица секций и секции, каждая с границы 64 байт.
+// Секции — разобранные столбцы, арена ФИО, слоты и postings хеш-таблицы
+// и строки, отсортированные по ФИО. Внутри только номера строк и
+// смещения, без указателей, поэтому снимок открывается одним mmap и
+// годится на месте. У заголовка и у каждой секции своя контрольная
+// сумма (hashKey по байтам); секции сверяются только по запросу,
+// иначе открытие не трогало бы каждую страницу файла.
+const char SNAPSHOT_MAGIC[8] = {'A', 'P', 'T', 'S', 'N', 'A', 'P', '\0'};
+const uint32_t SNAPSHOT_VERSION = 1;
+const uint32_t SNAPSHOT_ENDIAN = 0x01020304; // другой порядок байт — другое число
+const size_t SNAPSHOT_ALIGN = 64;
+
+enum SnapshotSection {
+    SNAP_APARTMENT, SNAP_AREA, SNAP_ROOMS, SNAP_PRICE, SNAP_FLOOR,
+    SNAP_KEY_OFFSET, SNAP_NAMES, SNAP_HASH_SLOTS, SNAP_POSTINGS, SNAP_SORTED, SNAP_SECTIONS
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint64_t rows;
+    uint64_t fileSize;
+    uint64_t hashMask;
+    uint32_t sectionCount;
+    uint32_t reserved;
+    uint64_t checksum; // заголовка и таблицы секций, с нулём в этом поле
+};
+
+struct SnapshotSectionEntry {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t checksum;
+};
+
+inline uint64_t snapshotChecksum(const void* data, size_t size) {
+    return hashKey(std::string_view(static_cast<const char*>(data), size));
+}
+
+// Пишет снимок таблицы с готовой хеш-таблицей по всем строкам
+bool writeSnapshot(const std::string& filename, const ApartmentTable& table, const HashTable& ht) {
+    std::vector<RowId> sorted(table.size());
+    for (RowId row = 0; row < sorted.size(); ++row) sorted[row] = row;
+    std::stable_sort(sorted.begin(), sorted.end(), [&](RowId a, RowId b) { return table.key(a) < table.key(b); });
+
+    auto bytes = [](const auto& v) {
+        return std::string_view(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(v[0]));
+    };
+    const std::string_view sections[SNAP_SECTIONS] = {
+        bytes(table.apartment), bytes(table.area), bytes(table.rooms), bytes(table.price),
+        bytes(table.floor), bytes(table.keyOffset), table.names, bytes(ht.table), bytes(ht.postings),
+        bytes(sorted)};
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.endian = SNAPSHOT_ENDIAN;
+    header.rows = table.size();
+    header.hashMask = ht.mask;
+    header.sectionCount = SNAP_SECTIONS;
+
+    SnapshotSectionEntry entries[SNAP_SECTIONS];
+    auto align = [](uint64_t v) { return (v + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN; };
+    uint64_t offset = align(sizeof(header) + sizeof(entries));
+    for (int s = 0; s < SNAP_SECTIONS; ++s) {
+        entries[s] = {offset, sections[s].size(), snapshotChecksum(sections[s].data(), sections[s].size())};
+        offset = align(offset + sections[s].size());
+    }
+    header.fileSize = offset;
+    std::string prefix(reinterpret_cast<const char*>(&header), sizeof(header));
+    prefix.append(reinterpret_cast<const char*>(entries), sizeof(entries));
+    header.checksum = snapshotChecksum(prefix.data(), prefix.size());
+    std::memcpy(prefix.data(), &header, sizeof(header));
+
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    const std::string padding(SNAPSHOT_ALIGN, '\0');
+    out.write(prefix.data(), prefix.size());
+    uint64_t written = prefix.size();
+    for (int s = 0; s < SNAP_SECTIONS; ++s) {
+        out.write(padding.data(), entries[s].offset - written);
+        out.write(sections[s].data(), sections[s].size());
+        written = entries[s].offset + sections[s].size();
+    }
+    out.write(padding.data(), header.fileSize - written);
+    return static_cast<bool>(out);
+}
+
+// Открытый снимок: все поля — окна в отображённый файл
+struct Snapshot {
+    MappedFile file;
+    size_t rows = 0;
+    std::span<const uint16_t> apartment, area;
+    std::span<const uint8_t> rooms, floor;
+    std::span<const float> price;
+    std::span<const uint32_t> keyOffset;
+    std::string_view names;
+    std::span<const HashSlot> slots;
+    std::span<const RowId> postings, sorted;
+    size_t mask = 0;
+
+    bool empty() const { return rows == 0; }
+
+    std::string_view key(RowId row) const {
+        return names.substr(keyOffset[row], keyOffset[row + 1] - keyOffset[row]);
+    }
+
+    // Строки с ФИО key, тот же Robin Hood, что в HashTable::find
+    std::span<const RowId> search(std::string_view key) const {
+        uint64_t h = hashKey(key);
+        size_t idx = h & mask;
+        for (uint32_t dist = 1; slots[idx].dist >= dist; ++dist) {
+            const HashSlot& slot = slots[idx];
+            if (slot.hash == h && this->key(slot.keyRow) == key) return postings.subspan(slot.first, slot.count);
+            idx = (idx + 1) & mask;
+        }
+        return {};
+    }
+
+    // Первая позиция в sorted с ФИО не меньше key
+    size_t lowerBound(std::string_view key) const {
+        return std::partition_point(sorted.begin(), sorted.end(),
+                                    [&](RowId row) { return this->key(row) < key; }) - sorted.begin();
+    }
+};
+
+// Открывает снимок. Проверяются заголовок, версия, размеры секций и
+// контрольная сумма заголовка; verify сверяет ещё и суммы всех секций.
+// При любой ошибке возвращает пустой снимок и пишет причину в error.
+Snapshot openSnapshot(const std::string& filename, bool verify, std::string& error) {
+    Snapshot snap;
+    snap.file = MappedFile(filename, MADV_RANDOM);
+    const char* base = snap.file.data;
+    size_t size = snap.file.size;
+    SnapshotHeader header;
+    SnapshotSectionEntry entries[SNAP_SECTIONS];
+    if (!base || size < sizeof(header) + sizeof(entries)) {
+        error = "file is missing or too small";
+        return {};
+    }
+    std::memcpy(&header, base, sizeof(header));
+    std::memcpy(entries, base + sizeof(header), sizeof(entries));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        error = "not a snapshot";
+        return {};
+    }
+    if (header.version != SNAPSHOT_VERSION || header.endian != SNAPSHOT_ENDIAN ||
+        header.sectionCount != SNAP_SECTIONS) {
+        error = "unsupported version " + std::to_string(header.version);
+        return {};
+    }
+    std::string prefix(base, sizeof(header) + sizeof(entries));
+    std::memset(prefix.data() + offsetof(SnapshotHeader, checksum), 0, sizeof(header.checksum));
+    if (header.fileSize != size || snapshotChecksum(prefix.data(), prefix.size()) != header.checksum) {
+        error = "header checksum mismatch";
+        return {};
+    }
+
+    const uint64_t rows = header.rows;
+    const uint64_t expected[SNAP_SECTIONS] = {
+        rows * 2, rows * 2, rows, rows * 4, rows, (rows + 1) * 4, entries[SNAP_NAMES].size,
+        (header.hashMask + 1) * sizeof(HashSlot), rows * sizeof(RowId), rows * sizeof(RowId)};
+    for (int s = 0; s < SNAP_SECTIONS; ++s) {
+        const SnapshotSectionEntry& e = entries[s];
+        if (e.size != expected[s] || e.offset % SNAPSHOT_ALIGN != 0 || e.offset + e.size > size) {
+            error = "section " + std::to_string(s) + " is malformed";
+            return {};
+        }
+        if (verify && snapshotChecksum(base + e.offset, e.size) != e.checksum) {
+            error = "section " + std::to_string(s) + " checksum mismatch";
+            return {};
+        }
+    }
+
+    auto section = [&]<typename T>(SnapshotSection s, std::span<const T>& out) {
+        out = std::span<const T>(reinterpret_cast<const T*>(base + entries[s].offset), entries[s].size / sizeof(T));
+    };
+    section(SNAP_APARTMENT, snap.apartment);
+    section(SNAP_AREA, snap.area);
+    section(SNAP_ROOMS, snap.rooms);
+    section(SNAP_PRICE, snap.price);
+    section(SNAP_FLOOR, snap.floor);
+    section(SNAP_KEY_OFFSET, snap.keyOffset);
+    section(SNAP_HASH_SLOTS, snap.slots);
+    section(SNAP_POSTINGS, snap.postings);
+    section(SNAP_SORTED, snap.sorted);
+    snap.names = std::string_view(base + entries[SNAP_NAMES].offset, entries[SNAP_NAMES].size);
+    snap.mask = header.hashMask;
+    snap.rows = rows;
+    return snap;
+}
+
+// main snapshot <apartments_N.txt> <out.snap>
+int runSnapshotConverter(int argc, char** argv) {
+    if (argc < 4) {
+        std::cerr << "usage: main snapshot <apartments_N.txt> <out.snap>\n";
+        return 1;
+    }
+    auto data = loadDataset(argv[2]);
+    if (data.empty()) {
+        std::cerr << "[ERROR] Dataset " << argv[2] << " is empty or unreadable.\n";
+        return 1;
+    }
+    HashTable ht(data);
+    ht.build();
+    if (!writeSnapshot(argv[3], data, ht)) {
+        std::cerr << "[ERROR] Cannot write " << argv[3] << ".\n";
+        return 1;
+    }
+    std::string error;
+    if (openSnapshot(argv[3], true, error).empty()) {
+        std::cerr << "[ERROR] Written snapshot does not verify: " << error << "\n";
+        return 1;
+    }
+    std::cout << "Wrote " << data.size() << " rows to " << argv[3] << "\n";
+    return 0;
+}
+
+// === Генератор нагрузки ===
+// Поток запросов: ключи-попадания с распределением Ципфа по популярности
+// и доля промахов — ФИО, которых нет в наборе. Всё определяется seed,
+// поток можно записать в файл и воспроизвести.
+struct WorkloadConfig {
+    uint64_t seed = 42;
+    double zipf = 0;        // показатель Ципфа, 0 — равномерно
+    double missRatio = 0;   // доля запросов-промахов
+    size_t length = 256;    // запросов в потоке
+};
+
+// Части ФИО из gener.py
+const std::vector<std::string> maleFirstNames = {
+    "Алексей", "Дмитрий", "Сергей", "Николай", "Иван", "Андрей", "Владимир", "Михаил",
+    "Анатолий", "Виктор", "Станислав", "Роман", "Константин", "Евгений", "Павел",
+    "Григорий", "Юрий", "Фёдор", "Денис", "Максим", "Арсений", "Игорь", "Виталий",
+    "Тимур", "Александр", "Даниил", "Матвей", "Олег", "Ярослав"};
+const std::vector<std::string> femaleFirstNames = {
+    "Анна", "Мария", "Ольга", "Елена", "Татьяна", "Наталья", "Ирина", "Светлана",
+    "Ксения", "Юлия", "Анастасия", "Дарья", "Виктория", "Екатерина", "Людмила",
+    "Нина", "Алёна", "Тамара", "София", "Вероника", "Полина", "Маргарита",
+    "Зинаида", "Евгения", "Лилия", "Оксана", "Галина"};
+const std::vector<std::string> lastNames = {
+    "Иванов", "Петров", "Сидоров", "Смирнов", "Кузнецов", "Попов",
+    "Васильев", "Новиков", "Фёдоров", "Морозов", "Волков", "Соколов",
+    "Зайцев", "Беляев", "Громов", "Ковалёв", "Мельников",
+    "Сергеев", "Давыдов", "Тихонов", "Фролов",
+    "Лебедев", "Баранов", "Кириллов", "Семёнов"};
+const std::vector<std::string> maleMiddleNames = {
+    "Алексеевич", "Дмитриевич", "Сергеевич", "Иванович", "Петрович", "Анатольевич",
+    "Николаевич", "Владимирович", "Андреевич", "Михайлович", "Викторович",
+    "Станиславович", "Романович", "Константинович", "Евгеньевич", "Павлович"};
+const std::vector<std::string> femaleMiddleNames = {
+    "Алексеевна", "Дмитриевна", "Сергеевна", "Ивановна", "Петровна", "Анатольевна",
+    "Николаевна", "Владимировна", "Андреевна", "Михайловна", "Викторовна",
+    "Станиславовна", "Романовна", "Константиновна", "Евгеньевна", "Павловна"};
+
+// Все ФИО, которые может выдать gener.py (с правилом женской фамилии)
+std::vector<std::string> possibleNames() {
+    std::vector<std::string> names;
+    for (const auto& last : lastNames) {
+        for (const auto& first : maleFirstNames)
+            for (const auto& middle : maleMiddleNames) names.push_back(last + " " + first + " " + middle);
+        for (const auto& first : femaleFirstNames)
+            for (const auto& middle : femaleMiddleNames) names.push_back(last + "а " + first + " " + middle);
+    }
+    return names;
+}
+
+// ФИО, которых gener.py не выдаёт никогда: мужское имя с женским отчеством
+std::vector<std::string> impossibleNames() {
+    std::vector<std::string> names;
+    for (const auto& last : lastNames)
+        for (const auto& first : maleFirstNames)
+            for (const auto& middle : femaleMiddleNames) names.push_back(last + " " + first + " " + middle);
+    return names;
+}
+
+// Уникальные ключи таблицы по возрастанию
+std::vector<std::string_view> distinctKeys(const ApartmentTable& table) {
+    std::vector<std::string_view> keys(table.size());
+    for (RowId row = 0; row < table.size(); ++row) keys[row] = table.key(row);
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+struct QueryTrace {
+    WorkloadConfig config;
+    std::vector<std::string> keys;
+    std::vector<bool> hit; // ожидается ли ключ в наборе
+
+    // Ключи как string_view для функций поиска; живут, пока жив trace
+    std::vector<std::string_view> views() const {
+        return std::vector<std::string_view>(keys.begin(), keys.end());
+    }
+};
+
+QueryTrace generateTrace(const ApartmentTable& table, const WorkloadConfig& config) {
+    QueryTrace trace;
+    trace.config = config;
+    std::mt19937_64 rng(config.seed);
+
+    // Популярность ключей не должна совпадать с алфавитом, поэтому ранги
+    // раздаются случайной перестановкой
+    std::vector<std::string_view> sorted = distinctKeys(table);
+    std::vector<std::string_view> present = sorted;
+    std::shuffle(present.begin(), present.end(), rng);
+    std::vector<double> cdf(present.size());
+    double sum = 0;
+    for (size_t i = 0; i < present.size(); ++i) {
+        sum += 1.0 / std::pow(double(i + 1), config.zipf);
+        cdf[i] = sum;
+    }
+
+    std::vector<std::string> missing;
+    for (auto& name : possibleNames()) {
+        if (!std::binary_search(sorted.begin(), sorted.end(), name)) missing.push_back(std::move(name));
+    }
+    // На больших наборах gener.py успевает выдать почти все ФИО
+    if (missing.empty()) missing = impossibleNames();
+
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    trace.keys.reserve(config.length);
+    for (size_t i = 0; i < config.length; ++i) {
+        bool miss = present.empty() || unit(rng) < config.missRatio;
+        if (miss) {
+            trace.keys.push_back(missing[rng() % missing.size()]);
+        }
+        else {
+            size_t rank = std::lower_bound(cdf.begin(), cdf.end(), unit(rng) * sum) - cdf.begin();
+            trace.keys.emplace_back(present[std::min(rank, present.size() - 1)]);
+        }
+        trace.hit.push_back(!miss);
+    }
+    return trace;
+}
+
+// Формат: строка с параметрами, затем по ключу на строку с пометкой h/m
+bool saveTrace(const QueryTrace& trace, const std::string& filename) {
+    std::ofstream out(filename);
+    const WorkloadConfig& c = trace.config;
+    out << "# seed=" << c.seed << " zipf=" << c.zipf << " miss=" << c.missRatio
+        << " length=" << c.length << "\n";
+    for (size_t i = 0; i < trace.keys.size(); ++i) {
+        out << (trace.hit[i] ? 'h' : 'm') << "," << trace.keys[i] << "\n";
+    }
+    return bool(out);
+}
+
+QueryTrace loadTrace(const std::string& filename) {
+    QueryTrace trace;
+    std::ifstream in(filename);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#' || line.size() < 2) continue;
+        trace.hit.push_back(line[0] == 'h');
+        trace.keys.push_back(line.substr(2));
+    }
+    trace.config.length = trace.keys.size();
+    return trace;
+}
+
+// Параметры запуска бенчмарка поиска
+struct BenchOptions {
+    WorkloadConfig workload;
+    std::string traceFile;
+    bool perf = false; // снимать аппаратные счётчики
+    std::string socketPath = "apartments.sock"; // сокет сервиса поиска
+    int port = 0;        // если задан, сервис слушает TCP 127.0.0.1:port вместо сокета
+    double seconds = 1;  // длительность ступени генератора нагрузки
+};
+
+// Разбирает --seed, --zipf, --miss, --queries, --trace, --perf, --socket,
+// --port и --seconds начиная с argv[first]
+BenchOptions parseOptions(int argc, char** argv, int first) {
+    BenchOptions options;
+    WorkloadConfig& config = options.workload;
+    for (int i = first; i < argc; ++i) {
+        std::string opt = argv[i];
+        if (opt == "--perf") {
+            options.perf = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "[WARN] Option " << opt << " needs a value\n";
+            break;
+        }
+        const char* value = argv[++i];
+        if (opt == "--seed") config.seed = std::strtoull(value, nullptr, 10);
+        else if (opt == "--zipf") config.zipf = std::atof(value);
+        else if (opt == "--miss") config.missRatio = std::atof(value);
+        else if (opt == "--queries") config.length = std::strtoull(value, nullptr, 10);
+        else if (opt == "--trace") options.traceFile = value;
+        else if (opt == "--socket") options.socketPath = value;
+        else if (opt == "--port") options.port = std::atoi(value);
+        else if (opt == "--seconds") options.seconds = std::atof(value);
+        else std::cerr << "[WARN] Unknown option " << opt << "\n";
+    }
+    return options;
+}
+
+int runTraceGenerator(int argc, char** argv) {
+    if (argc < 4) {
+        std::cerr << "usage: main gentrace <apartments_N.txt> <trace.txt> [--seed S] [--zipf Z] [--miss M] [--queries N]\n";
+        return 1;
+    }
+    auto data = loadDataset(argv[2]);
+    if (data.empty()) {
+        std::cerr << "[ERROR] Dataset " << argv[2] << " is empty or unreadable.\n";
+        return 1;
+    }
+    QueryTrace trace = generateTrace(data, parseOptions(argc, argv, 4).workload);
+    if (!saveTrace(trace, argv[3])) {
+        std::cerr << "[ERROR] Cannot write " << argv[3] << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+// === Аппаратные счётчики (perf_event_open) ===
+// Счётчики открываются по одному, чтобы неподдерживаемое событие (например,
+// dTLB в виртуальной машине) не выключало остальные. Если ядро не даёт
+// открыть ничего, available() ложно и колонки в results.csv пишутся как NA.
+enum PerfCounter {
+    PERF_CYCLES, PERF_INSTRUCTIONS, PERF_L1D_MISSES, PERF_LLC_MISSES,
+    PERF_DTLB_MISSES, PERF_BRANCH_MISSES, PERF_COUNTERS
+};
+const char* const perfCounterNames[PERF_COUNTERS] = {
+    "Cycles", "Instructions", "L1DMisses", "LLCMisses", "DTLBMisses", "BranchMisses"};
+
+struct PerfCounters {
+    int fds[PERF_COUNTERS];
+
+    PerfCounters() {
+        auto cache = [](uint64_t id) {
+            return id | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        };
+        const std::pair<uint32_t, uint64_t> events[PERF_COUNTERS] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_L1D)},
+            {PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_LL)},
+            {PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_DTLB)},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        };
+        for (int i = 0; i < PERF_COUNTERS; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = events[i].first;
+            attr.config = events[i].second;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1; // при perf_event_paranoid = 2 можно только user
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+    }
+
+    ~PerfCounters() {
+        for (int fd : fds) {
+            if (fd >= 0) close(fd);
+        }
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const {
+        for (int fd : fds) {
+            if (fd >= 0) return true;
+        }
+        return false;
+    }
+
+    void start() {
+        for (int fd : fds) {
+            if (fd < 0) continue;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    // Останавливает счёт и возвращает значения; -1 — счётчик недоступен.
+    // Если ядро мультиплексировало события, значение масштабируется.
+    std::array<double, PERF_COUNTERS> stop() {
+        std::array<double, PERF_COUNTERS> values;
+        for (int i = 0; i < PERF_COUNTERS; ++i) {
+            values[i] = -1;
+            if (fds[i] < 0) continue;
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t data[3]; // value, time_enabled, time_running
+            if (read(fds[i], data, sizeof(data)) != sizeof(data) || data[2] == 0) continue;
+            values[i] = double(data[0]) * data[1] / data[2];
+        }
+        return values;
+    }
+};
+
+// === Измерение времени ===
+template<typename Func>
+long long measureTime(Func f) {
+    auto start = std::chrono::high_resolution_clock::now();
+    f();
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+}
+
+// Барьер для оптимизатора: значение считается использованным,
+// поэтому вызов поиска с отброшенным результатом не выкидывается
+template<typename T>
+inline void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Замер короче этого слишком близок к разрешению часов
+const long long MIN_SAMPLE_NS = 20000;
+
+struct TimingStats {
+    double median = 0, p99 = 0, mean = 0, stddev = 0;
+    size_t samples = 0;
+    double lookupsPerSample = 0;
+};
+
+// Замеры одной структуры: нс на поиск в каждом замере и суммы
+// аппаратных счётчиков за perfLookups поисков (-1 — счётчика нет)
+struct SampleSet {
+    std::vector<double> ns;
+    size_t lookups = 0;
+    std::array<double, PERF_COUNTERS> perf{};
+    size_t perfLookups = 0;
+
+    // Значение счётчика на один поиск или NaN
+    double perfPerLookup(int counter) const {
+        if (perfLookups == 0 || perf[counter] < 0) return std::nan("");
+        return perf[counter] / perfLookups;
+    }
+
+    TimingStats stats() const {
+        TimingStats st;
+        st.samples = ns.size();
+        if (ns.empty()) return st;
+        std::vector<double> sorted = ns;
+        std::sort(sorted.begin(), sorted.end());
+        st.median = sorted[sorted.size() / 2];
+        st.p99 = sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)];
+        for (double v : sorted) st.mean += v;
+        st.mean /= sorted.size();
+        for (double v : sorted) st.stddev += (v - st.mean) * (v - st.mean);
+        st.stddev = std::sqrt(st.stddev / sorted.size());
+        st.lookupsPerSample = double(lookups) / sorted.size();
+        return st;
+    }
+};
+
+// Делает samples замеров, в каждом — столько поисков по кругу из queries,
+// чтобы замер длился не меньше MIN_SAMPLE_NS. Число поисков подбирается
+// на прогреве, прогревочные замеры отбрасываются. Если передан perf,
+// счётчики снимаются вокруг всех замеров, кроме прогрева. Возвращает
+// число вызовов lookup вместе с прогревом.
+template<typename Query, typename Func>
+size_t sampleLookups(SampleSet& set, const std::vector<Query>& queries, Func lookup, int samples,
+                     PerfCounters* perf = nullptr) {
+    size_t next = 0, calls = 0;
+    auto run = [&](size_t n) {
+        calls += n;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < n; ++i) {
+            doNotOptimize(lookup(queries[next]));
+            next = next + 1 == queries.size() ? 0 : next + 1;
+        }
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    };
+    size_t batch = 1;
+    while (run(batch) < MIN_SAMPLE_NS && batch < (size_t(1) << 20)) batch *= 2;
+    if (perf) perf->start();
+    for (int s = 0; s < samples; ++s) {
+        set.ns.push_back(double(run(batch)) / batch);
+        set.lookups += batch;
+    }
+    if (perf) {
+        auto values = perf->stop();
+        for (int i = 0; i < PERF_COUNTERS; ++i) {
+            // Счётчик, пропавший хоть раз, не смешиваем с остальными замерами
+            set.perf[i] = values[i] < 0 || set.perf[i] < 0 ? -1 : set.perf[i] + values[i];
+        }
+        set.perfLookups += size_t(samples) * batch;
+    }
+    return calls;
+}
+
+// Пропускная способность: строк в секунду за micros микросекунд
+double rowsPerSec(size_t rows, long long micros) {
+    return micros > 0 ? rows * 1e6 / micros : 0;
+}
+
+// === Бенчмарк загрузки ===
+
+// Размеры наборов данных (файлы apartments_N.txt из gener.py)
+const std::vector<int> datasetSizes = {1000, 5000, 10000, 50000, 100000, 200000, 250000, 300000, 400000, 500000};
+
+struct LoadSample {
+    long long micros = -1;
+    long rssKb = -1; // пиковый RSS дочернего процесса
+};
+
+// Запускает загрузчик в отдельном процессе, чтобы пиковый RSS
+// одного загрузчика не смешивался с другим
+template<typename Func>
+LoadSample measureLoad(Func load) {
+    int fds[2];
+    if (pipe(fds) != 0) return {};
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return {};
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        long long t = measureTime(load);
+        ssize_t written = write(fds[1], &t, sizeof(t));
+        _exit(written == sizeof(t) ? 0 : 1);
+    }
+    close(fds[1]);
+    LoadSample sample;
+    if (read(fds[0], &sample.micros, sizeof(sample.micros)) != sizeof(sample.micros)) sample.micros = -1;
+    close(fds[0]);
+    int status = 0;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) == pid) sample.rssKb = usage.ru_maxrss;
+    return sample;
+}
+
+int runLoadBenchmark() {
+    std::ofstream out("load_results.csv");
+    out << "Size,StreamUs,MmapUs,StreamPeakRssKb,MmapPeakRssKb\n";
+
+    for (int size : datasetSizes) {
+        std::string filename = "apartments_" + std::to_string(size) + ".txt";
+        size_t rows = loadDataset(filename).size();
+        if (rows == 0) {
+            std::cerr << "[ERROR] Dataset " << filename << " is empty or unreadable.\n";
+            continue;
+        }
+
+        LoadSample stream = measureLoad([&]() {
+            auto keys = loadDatasetStream(filename);
+            if (keys.size() != rows) _exit(2);
+        });
+        LoadSample mapped = measureLoad([&]() {
+            auto data = loadDataset(filename);
+            if (data.size() != rows) _exit(2);
+        });
+
+        out << size << "," << stream.micros << "," << mapped.micros << ","
+            << stream.rssKb << "," << mapped.rssKb << "\n";
+        std::cout << "Size: " << size << " stream " << stream.micros << " us, mmap "
+                  << mapped.micros << " us\n";
+    }
+    return 0;
+}
+
+// Пишет снимок в отдельном процессе и возвращает ФИО первой строки
+// (пустую строку при ошибке). Родитель ничего не загружает сам:
+// дочерние замеры наследуют его резидентные страницы, и ru_maxrss
+// включал бы таблицу и индекс родителя.
+std::string prepareSnapshot(const std::string& filename, const std::string& snapName) {
+    int fds[2];
+    if (pipe(fds) != 0) return {};
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return {};
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        auto data = loadDataset(filename);
+        if (data.empty()) {
+            std::cerr << "[ERROR] Dataset " << filename << " is empty or unreadable.\n";
+            _exit(1);
+        }
+        HashTable ht(data);
+        ht.build();
+        std::string error;
+        if (!writeSnapshot(snapName, data, ht) || openSnapshot(snapName, true, error).empty()) {
+            std::cerr << "[ERROR] Snapshot " << snapName << " failed: " << error << "\n";
+            _exit(1);
+        }
+        std::string_view probe = data.key(0);
+        ssize_t written = write(fds[1], probe.data(), probe.size());
+        _exit(written == ssize_t(probe.size()) ? 0 : 1);
+    }
+    close(fds[1]);
+    std::string probe;
+    char buf[256];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0) probe.append(buf, n);
+    close(fds[0]);
+    int status = 0;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return {};
+    return probe;
+}
+
+// Запуск "с холодного старта" до первого ответа: текстовый путь
+// разбирает файл и строит хеш-таблицу, снимок только отображается.
+// Снимки apartments_N.snap пишутся рядом с текстовыми файлами.
+int runSnapshotBenchmark() {
+    std::ofstream out("snapshot_results.csv");
+    out << "Size,TextUs,SnapshotUs,VerifiedUs,TextPeakRssKb,SnapshotPeakRssKb,SnapshotBytes\n";
+
+    for (int size : datasetSizes) {
+        std::string filename = "apartments_" + std::to_string(size) + ".txt";
+        std::string snapName = "apartments_" + std::to_string(size) + ".snap";
+        // Первый запрос — ФИО первой строки, он обязан найтись
+        std::string probe = prepareSnapshot(filename, snapName);
+        if (probe.empty()) continue;
+
+        LoadSample text = measureLoad([&]() {
+            auto table = loadDataset(filename);
+            HashTable index(table);
+            index.build();
+            if (index.search(probe).empty()) _exit(2);
+        });
+        auto openAndProbe = [&](bool verify) {
+            std::string err;
+            Snapshot snap = openSnapshot(snapName, verify, err);
+            if (snap.search(probe).empty()) _exit(2);
+        };
+        LoadSample snapshot = measureLoad([&]() { openAndProbe(false); });
+        LoadSample verified = measureLoad([&]() { openAndProbe(true); });
+
+        struct stat st;
+        long long bytes = stat(snapName.c_str(), &st) == 0 ? st.st_size : -1;
+        out << size << "," << text.micros << "," << snapshot.micros << "," << verified.micros << ","
+            << text.rssKb << "," << snapshot.rssKb << "," << bytes << "\n";
+        std::cout << "Size: " << size << " text " << text.micros << " us, snapshot "
+                  << snapshot.micros << " us\n";
+    }
+    return 0;
+}
+
+// === Бенчмарк пакетного поиска ===
+
+// Наносекунд на ключ при поиске пакетами по batch ключей
+template<typename Func>
+double measureBatches(const std::vector<std::string_view>& queries, size_t batch, Func searchMany) {
+    BatchResult out;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t base = 0; base < queries.size(); base += batch) {
+        size_t n = std::min(batch, queries.size() - base);
+        searchMany(std::span<const std::string_view>(queries.data() + base, n), out);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / queries.size();
+}
+
+int runBatchBenchmark() {
+    std::ofstream out("batch_results.csv");
+    out << "Size,Batch,Hash,RBT,Eytzinger\n";
+
+    const size_t queryCount = 1 << 16;
+    for (int size : datasetSizes) {
+        std::string filename = "apartments_" + std::to_string(size) + ".txt";
+        auto data = loadDataset(filename);
+        if (data.empty()) {
+            std::cerr << "[ERROR] Dataset " << filename << " is empty or unreadable.\n";
+            continue;
+        }
+
+        HashTable ht(data);
+        ht.build();
+        RBTree rbt;
+        for (RowId row = 0; row < data.size(); ++row) insertRBT(rbt, data.key(row), row);
+        EytzingerIndex eytz;
+        eytz.build(data);
+
+        WorkloadConfig config;
+        config.length = queryCount;
+        QueryTrace trace = generateTrace(data, config);
+        std::vector<std::string_view> queries = trace.views();
+
+        for (size_t batch : {1, 8, 64, 1024}) {
+            double hash = measureBatches(queries, batch, [&](auto keys, BatchResult& res) {
+                ht.searchMany(keys, res);
+            });
+            double rb = measureBatches(queries, batch, [&](auto keys, BatchResult& res) {
+                searchManyRBT(rbt, keys, res);
+            });
+            double ey = measureBatches(queries, batch, [&](auto keys, BatchResult& res) {
+                eytz.searchMany(keys, res);
+            });
+            out << size << "," << batch << "," << hash << "," << rb << "," << ey << "\n";
+        }
+        std::cout << "Size: " << size << " done.\n";
+    }
+    return 0;
+}
+
+// === Бенчмарк масштабирования по потокам ===
+int runParallelBenchmark() {
+    std::ofstream out("parallel_results.csv");
+    out << "Size,Threads,ScanUs,HashBuildUs,TreeBuildUs\n";
+
+    const int scans = 20;
+    for (int size : datasetSizes) {
+        std::string filename = "apartments_" + std::to_string(size) + ".txt";
+        auto data = loadDataset(filename);
+        if (data.empty()) {
+            std::cerr << "[ERROR] Dataset " << filename << " is empty or unreadable.\n";
+            continue;
+        }
+        auto prints = buildFingerprints(data);
+        WorkloadConfig config;
+        config.length = scans;
+        QueryTrace trace = generateTrace(data, config);
+
+        for (size_t threads : {1, 2, 4, 8, 16, 32}) {
+            ThreadPool pool(threads);
+
+            long long scan = measureTime([&]() {
+                for (const auto& key : trace.keys) parallelLinearSearch(pool, data, prints, key);
+            }) / scans;
+
+            PartitionedHashTable pht;
+            long long hashBuild = measureTime([&]() {
+                pht.build(pool, data);
+            });
+
+            RBTree rbt;
+            long long treeBuild = measureTime([&]() {
+                bulkBuildRBT(pool, rbt, data, parallelSortRows(pool, data));
+            });
+
+            out << size << "," << threads << "," << scan << "," << hashBuild << "," << treeBuild << "\n";
+        }
+        std::cout << "Size: " << size << " done.\n";
+    }
+    return 0;
+}
+
+// Метрики одной структуры на одном размере
+struct StructureMetrics {
+    long long buildUs = 0;
+    size_t bytes = 0; // живые байты после сборки по счётчику выделений
+    SampleSet lookups;
+};
+
+// Строит структуру один раз, замеряя время и прирост живой памяти
+template<typename Func>
+void measureBuild(StructureMetrics& m, Func build) {
+    size_t before = allocStats().liveBytes;
+    m.buildUs = measureTime(build);
+    size_t after = allocStats().liveBytes;
+    m.bytes = after > before ? after - before : 0;
+}
+
+// === Бенчмарк интернирования ключей ===
+// Каждая структура строится дважды: по строкам из арены таблицы и по
+// номерам из KeyDictionary. Интернированный поиск сначала один раз
+// переводит запрос в номер, дальше сравниваются только числа. Время
+// интернирования входит в InternedNs; строка Dictionary показывает
+// сам словарь с номерами строк против ФИО таблицы и чистое время find.
+int runInternBenchmark() {
+    std::ofstream out("intern_results.csv");
+    out << "Size,Structure,StringNs,InternedNs,StringBytes,InternedBytes,SavedBytes\n";
+
+    const int samples = 20;
+    for (int size : datasetSizes) {
+        std::string filename = "apartments_" + std::to_string(size) + ".txt";
+        auto data = loadDataset(filename);
+        if (data.empty()) {
+            std::cerr << "[ERROR] Dataset " << filename << " is empty or unreadable.\n";
+            continue;
+        }
+
+        std::vector<KeyId> rowKeys;
+        KeyDictionary dict;
+        StructureMetrics dictBuild;
+        measureBuild(dictBuild, [&]() { dict = buildKeyDictionary(data, rowKeys); });
+
+        std::map<std::string, StructureMetrics> byString, byId;
+        BSTree bst;
+        measureBuild(byString["BST"], [&]() {
+            for (RowId row = 0; row < data.size(); ++row) insertBST(bst, data.key(row), row);
+        });
+        BSTreeT<KeyId> bstId;
+        measureBuild(byId["BST"], [&]() {
+            for (RowId row = 0; row < data.size(); ++row) insertBST(bstId, rowKeys[row], row);
+        });
+        RBTree rbt;
+        measureBuild(byString["RBT"], [&]() {
+            for (RowId row = 0; row < data.size(); ++row) insertRBT(rbt, data.key(row), row);
+        });
+        RBTreeT<KeyId> rbtId;
+        measureBuild(byId["RBT"], [&]() {
+            for (RowId row = 0; row < data.size(); ++row) insertRBT(rbtId, rowKeys[row], row);
+        });
+        std::multimap<std::string_view, RowId> mm;
+        measureBuild(byString["Multimap"], [&]() {
+            for (RowId row = 0; row < data.size(); ++row) mm.insert({data.key(row), row});
+        });
+        std::multimap<KeyId, RowId> mmId;
+        measureBuild(byId["Multimap"], [&]() {
+            for (RowId row = 0; row < data.size(); ++row) mmId.insert({rowKeys[row], row});
+        });
+        HashTable ht(data);
+        measureBuild(byString["Hash"], [&]() { ht.build(); });
+        KeyPostings postings;
+        measureBuild(byId["Hash"], [&]() { postings.build(rowKeys, dict.size()); });
+
+        QueryTrace trace = generateTrace(data, WorkloadConfig());
+        std::vector<std::string_view> queries = trace.views();
+        auto sum = [](auto begin, auto end) {
+            size_t n = 0;
+            for (auto it = begin; it != end; ++it) n += it->second;
+            return n;
+        };
+
+        SampleSet internOnly;
+        sampleLookups(internOnly, queries, [&](std::string_view key) { return dict.find(key); }, samples);
+        std::vector<RowId> res;
+        sampleLookups(byString["BST"].lookups, queries, [&](std::string_view key) {
+            res.clear();
+            searchBST(bst, key, res);
+            return res.size();
+        }, samples);
+        sampleLookups(byId["BST"].lookups, queries, [&](std::string_view key) {
+            res.clear();
+            KeyId id = dict.find(key);
+            if (id != NO_KEY) searchBST(bstId, id, res);
+            return res.size();
+        }, samples);
+        sampleLookups(byString["RBT"].lookups, queries, [&](std::string_view key) { return searchRBT(rbt, key); }, samples);
+        sampleLookups(byId["RBT"].lookups, queries, [&](std::string_view key) {
+            KeyId id = dict.find(key);
+            return id == NO_KEY ? std::span<const RowId>() : searchRBT(rbtId, id);
+        }, samples);
+        sampleLookups(byString["Multimap"].lookups, queries, [&](std::string_view key) {
+            auto range = mm.equal_range(key);
+            return sum(range.first, range.second);
+        }, samples);
+        sampleLookups(byId["Multimap"].lookups, queries, [&](std::string_view key) {
+            auto range = mmId.equal_range(dict.find(key));
+            return sum(range.first, range.second);
+        }, samples);
+        sampleLookups(byString["Hash"].lookups, queries, [&](std::string_view key) { return ht.search(key); }, samples);
+        sampleLookups(byId["Hash"].lookups, queries, [&](std::string_view key) {
+            return postings.search(dict.find(key)).size();
+        }, samples);
+
+        size_t tableKeyBytes = data.names.capacity() + data.keyOffset.capacity() * sizeof(uint32_t);
+        size_t dictBytes = dictBuild.bytes;
+        out << size << ",Dictionary,0," << internOnly.stats().median << "," << tableKeyBytes << ","
+            << dictBytes << "," << static_cast<long long>(tableKeyBytes) - static_cast<long long>(dictBytes) << "\n";
+        for (const char* name : {"BST", "RBT", "Multimap", "Hash"}) {
+            const StructureMetrics& s = byString[name];
+            const StructureMetrics& i = byId[name];
+            out << size << "," << name << "," << s.lookups.stats().median << "," << i.lookups.stats().median << ","
+                << s.bytes << "," << i.bytes << ","
+                << static_cast<long long>(s.bytes) - static_cast<long long>(i.bytes) << "\n";
+        }
+        std::cout << "Size: " << size << " done, " << dict.size() << " distinct keys.\n";
+    }
+    return 0;
+}
+
+// === Бенчмарк префиксного поиска ===
+// Префиксы из первых 1/3/6/12 символов ключей потока запросов. Rows —
+// все строки с префиксом, Top10 — первые 10 различных ФИО. Базовая
+// линия — std::multimap: lower_bound и проход, пока ключ с префиксом.
+int runPrefixBenchmark() {
+    std::ofstream out("prefix_results.csv");
+    out << "Size,PrefixChars,AvgRows,RadixRowsNs,MultimapRowsNs,RadixTop10Ns,MultimapTop10Ns,"
+           "RadixBytes,MultimapBytes\n";
+
+    const int samples = 20;
+    const size_t topK = 10;
+    for (int size : datasetSizes) {
+        std::string filename = "apartments_" + std::to_string(size) + ".txt";
+        auto data = loadDataset(filename);
+        if (data.empty()) {
+            std::cerr << "[ERROR] Dataset " << filename << " is empty or unreadable.\n";
+            continue;
+        }
+
+        // Префиксному индексу нужны словарь и postings, их память входит в его счёт
+        std::vector<KeyId> rowKeys;
+        KeyDictionary dict;
+        KeyPostings postings;
+        PrefixIndex radix(dict, postings);
+        StructureMetrics radixBuild;
+        measureBuild(radixBuild, [&]() {
+            dict = buildKeyDictionary(data, rowKeys);
+            postings.build(rowKeys, dict.size());
+            radix.build();
+            std::vector<KeyId>().swap(rowKeys);
+        });
+        std::multimap<std::string_view, RowId> mm;
+        StructureMetrics mmBuild;
+        measureBuild(mmBuild, [&]() {
+            for (RowId row = 0; row < data.size(); ++row) mm.insert({data.key(row), row});
+        });
+
+        QueryTrace trace = generateTrace(data, WorkloadConfig());
+        std::vector<std::string_view> completions;
+        for (size_t chars : {1, 3, 6, 12}) {
+            std::vector<std::string_view> queries;
+            size_t matched = 0;
+            for (std::string_view key : trace.views()) {
+                queries.push_back(utf8Prefix(key, chars));
+                matched += radix.rows(queries.back()).size();
+            }
+
+            SampleSet radixRows, mmRows, radixTop, mmTop;
+            sampleLookups(radixRows, queries, [&](std::string_view p) {
+                size_t n = 0;
+                for (RowId row : radix.rows(p)) n += row;
+                return n;
+            }, samples);
+            sampleLookups(mmRows, queries, [&](std::string_view p) {
+                size_t n = 0;
+                for (auto it = mm.lower_bound(p); it != mm.end() && it->first.starts_with(p); ++it) n += it->second;
+                return n;
+            }, samples);
+            sampleLookups(radixTop, queries, [&](std::string_view p) {
+                radix.complete(p, topK, completions);
+                return completions.size();
+            }, samples);
+            sampleLookups(mmTop, queries, [&](std::string_view p) {
+                completions.clear();
+                for (auto it = mm.lower_bound(p); it != mm.end() && it->first.starts_with(p); ++it) {
+                    if (!completions.empty() && completions.back() == it->first) continue;
+                    if (completions.size() == topK) break;
+                    completions.push_back(it->first);
+                }
+                return completions.size();
+            }, samples);
+
+            out << size << "," << chars << "," << double(matched) / queries.size() << ","
+                << radixRows.stats().median << "," << mmRows.stats().median << ","
+                << radixTop.stats().median << "," << mmTop.stats().median << ","
+                << radixBuild.bytes << "," << mmBuild.bytes << "\n";
+        }
+        std::cout << "Size: " << size << " done, " << radix.nodes.size() << " radix nodes.\n";
+    }
+    return 0;
+}
+
+// === Бенчмарк диапазонных запросов ===
+// Наборы по 256 случайных запросов одной формы (seed 42). Example —
+// пример из задачи: 2–3 комнаты, площадь 40–80, цена < 60, этаж > 1.
+// NamePrice — ФИО из потока запросов плюс цена и комнаты; индекс берёт
+// строки ФИО из хеш-таблицы, проход проверяет имя в каждой строке.
+int runRangeBenchmark() {
+    std::ofstream out("range_results.csv");
+    out << "Size,Query,AvgRows,ScanNs,IndexNs,IndexBytes\n";
+
+    const int samples = 20;
+    const size_t queryCount = 256;
+    for (int size : datasetSizes) {
+        std::string filename = "apartments_" + std::to_string(size) + ".txt";
+        auto data = loadDataset(filename);
+        if (data.empty()) {
+            std::cerr << "[ERROR] Dataset " << filename << " is empty or unreadable.\n";
+            continue;
+        }
+
+        AttributeIndex index(data);
+        StructureMetrics indexBuild;
+        measureBuild(indexBuild, [&]() { index.build(); });
+        HashTable ht(data);
+        ht.build();
+
+        std::mt19937 rng(42);
+        auto uniform = [&](int lo, int hi) { return std::uniform_int_distribution<int>(lo, hi)(rng); };
+        std::vector<std::pair<std::string, std::vector<RangeQuery>>> shapes(5);
+        shapes[0].first = "Example";
+        shapes[1].first = "NarrowArea";
+        shapes[2].first = "NarrowPrice";
+        shapes[3].first = "RoomsFloor";
+        shapes[4].first = "Wide";
+        for (size_t i = 0; i < queryCount; ++i) {
+            RangeQuery q;
+            q.roomsMin = 2, q.roomsMax = 3, q.areaMin = 40, q.areaMax = 80, q.priceMax = 59.9f, q.floorMin = 2;
+            shapes[0].second.push_back(q);
+
+            q = RangeQuery();
+            q.areaMin = static_cast<uint16_t>(uniform(5, 298));
+            q.areaMax = q.areaMin + 2;
+            q.floorMin = 2;
+            shapes[1].second.push_back(q);
+
+            q = RangeQuery();
+            q.priceMin = static_cast<float>(uniform(20, 149));
+            q.priceMax = q.priceMin + 0.5f;
+            q.roomsMax = 3;
+            shapes[2].second.push_back(q);
+
+            q = RangeQuery();
+            q.roomsMin = q.roomsMax = static_cast<uint8_t>(uniform(1, 5));
+            q.floorMin = q.floorMax = static_cast<uint8_t>(uniform(1, 6));
+            shapes[3].second.push_back(q);
+
+            q = RangeQuery();
+            q.areaMin = static_cast<uint16_t>(uniform(5, 100));
+            q.areaMax = q.areaMin + 200;
+            shapes[4].second.push_back(q);
+        }
+
+        std::vector<RowId> res;
+        for (const auto& [name, queries] : shapes) {
+            size_t matched = 0;
+            for (const RangeQuery& q : queries) matched += rangeScan(data, q).size();
+            SampleSet scan, indexed;
+            sampleLookups(scan, queries, [&](const RangeQuery& q) { return rangeScan(data, q).size(); }, samples);
+            sampleLookups(indexed, queries, [&](const RangeQuery& q) {
+                index.search(q, res);
+                return res.size();
+            }, samples);
+            out << size << "," << name << "," << double(matched) / queries.size() << "," << scan.stats().median
+                << "," << indexed.stats().median << "," << indexBuild.bytes << "\n";
+        }
+
+        // Смешанные условия: ФИО и числовые поля
+        QueryTrace trace = generateTrace(data, WorkloadConfig());
+        std::vector<std::pair<std::string_view, RangeQuery>> mixed;
+        for (std::string_view key : trace.views()) {
+            RangeQuery q;
+            q.priceMax = 59.9f;
+            q.roomsMin = 2, q.roomsMax = 3;
+            mixed.push_back({key, q});
+        }
+        size_t matched = 0;
+        auto scanMixed = [&](const std::pair<std::string_view, RangeQuery>& m) {
+            std::vector<RowId> results;
+            for (RowId row = 0; row < data.size(); ++row) {
+                if (m.second.matches(data, row) && keysEqual(data.key(row), m.first)) results.push_back(row);
+            }
+            return results;
+        };
+        auto indexMixed = [&](const std::pair<std::string_view, RangeQuery>& m) {
+            const HashSlot* slot = ht.find(m.first);
+            std::span<const RowId> rows;
+            if (slot) rows = std::span<const RowId>(ht.postings.data() + slot->first, slot->count);
+            index.filter(rows, m.second, res);
+            return res.size();
+        };
+        for (const auto& m : mixed) matched += scanMixed(m).size();
+        SampleSet scan, indexed;
+        sampleLookups(scan, mixed, [&](const auto& m) { return scanMixed(m).size(); }, samples);
+        sampleLookups(indexed, mixed, indexMixed, samples);
+        out << size << ",NamePrice," << double(matched) / mixed.size() << "," << scan.stats().median << ","
+            << indexed.stats().median << "," << indexBuild.bytes + ht.table.capacity() * sizeof(HashSlot) +
+               ht.postings.capacity() * sizeof(RowId) << "\n";
+
+        std::cout << "Size: " << size << " done.\n";
+    }
+    return 0;
+}
+
+// === Бенчмарк смешанной нагрузки чтение/запись ===
+// threads потоков в течение MIX_DURATION_MS выполняют операции над
+// реестром: с вероятностью writePercent% — запись (по очереди удаление,
+// вставка и смена ФИО случайной строки), иначе поиск по хеш-индексу
+// или дереву. Пишется пропускная способность чтений и записей,
+// повторы читателей и записи, ждавшие выхода читателей.
+const int MIX_DURATION_MS = 200;
+
+int runMixedBenchmark() {
+    std::ofstream out("mixed_results.csv");
+    out << "Size,Threads,WritePercent,ReadsPerSec,WritesPerSec,RetriesPerRead,GraceWaits\n";
+
+    const std::vector<std::string>& names = possibleNames();
+    for (int size : datasetSizes) {
+        std::string filename = "apartments_" + std::to_string(size) + ".txt";
+        auto data = loadDataset(filename);
+        if (data.empty()) {
+            std::cerr << "[ERROR] Dataset " << filename << " is empty or unreadable.\n";
+            continue;
+        }
+        QueryTrace trace = generateTrace(data, WorkloadConfig());
+        std::vector<std::string_view> queries = trace.views();
+
+        for (int threads : {1, 2, 4, 8}) {
+            for (int writePercent : {0, 1, 10, 50}) {
+                Registry registry(data, data.size());
+
+                std::atomic<bool> stop{false};
+                std::atomic<uint64_t> reads{0}, writes{0};
+                std::vector<std::thread> workers;
+                for (int t = 0; t < threads; ++t) {
+                    workers.emplace_back([&, t]() {
+                        ReaderSlot& slot = registry.registerReader();
+                        std::mt19937 rng(1000 + t);
+                        uint64_t localReads = 0, localWrites = 0;
+                        std::vector<RowId> found;
+                        size_t next = t;
+                        while (!stop.load(std::memory_order_relaxed)) {
+                            if (int(rng() % 100) < writePercent) {
+                                RowId row = rng() % data.size();
+                                const std::string& name = names[rng() % names.size()];
+                                switch (localWrites % 3) {
+                                case 0: registry.erase(row); break;
+                                case 1: registry.insert(1, 50, 2, 50.0f, 1, name); break;
+                                default: registry.update(row, name); break;
+                                }
+                                localWrites++;
+                            }
+                            else {
+                                std::string_view key = queries[next++ % queries.size()];
+                                if (localReads & 1) doNotOptimize(registry.searchOrdered(slot, key, found));
+                                else doNotOptimize(registry.search(slot, key, found));
+                                localReads++;
+                            }
+                        }
+                        reads += localReads;
+                        writes += localWrites;
+                    });
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(MIX_DURATION_MS));
+                stop = true;
+                for (auto& w : workers) w.join();
+
+                double seconds = MIX_DURATION_MS / 1000.0;
+                out << size << "," << threads << "," << writePercent << "," << reads / seconds << ","
+                    << writes / seconds << "," << double(registry.retries) / std::max<uint64_t>(reads, 1) << ","
+                    << registry.graceWaits << "\n";
+            }
+        }
+        std::cout << "Size: " << size << " done.\n";
+    }
+    return 0;
+}
+
+// === Проверка поиска без выделений памяти ===
+// Каждый поиск гоняется по потоку запросов: первый проход прогревает
+// буферы, затем ещё ALLOC_CHECK_PASSES проходов, за которые счётчик
+// выделений operator new не должен сдвинуться. Результат —
+// alloc_results.csv и код возврата 1, если хоть один поиск выделял.
+const int ALLOC_CHECK_PASSES = 4;
+
+int runAllocationCheck() {
+    std::ofstream out("alloc_results.csv");
+    out << "Size,Structure,Lookups,Allocations\n";
+
+    bool clean = true;
+    for (int size : datasetSizes) {
+        std::string filename = "apartments_" + std::to_string(size) + ".txt";
+        auto data = loadDataset(filename);
+        if (data.empty()) {
+            std::cerr << "[ERROR] Dataset " << filename << " is empty or unreadable.\n";
+            continue;
+        }
+
+        std::vector<uint32_t> prints = buildFingerprints(data);
+        BSTree bst;
+        RBTree rbt;
+        std::multimap<std::string_view, RowId> mm;
+        BPlusTree bplus;
+        for (RowId row = 0; row < data.size(); ++row) {
+            insertBST(bst, data.key(row), row);
+            insertRBT(rbt, data.key(row), row);
+            mm.insert({data.key(row), row});
+            insertBPlus(bplus, data.key(row), row);
+        }
+        HashTable ht(data);
+        ht.build();
+        EytzingerIndex eytz;
+        eytz.build(data);
+        Registry registry(data);
+        ReaderSlot& slot = registry.registerReader();
+
+        WorkloadConfig config;
+        config.missRatio = 0.1;
+        QueryTrace trace = generateTrace(data, config);
+        std::vector<std::string_view> queries = trace.views();
+        std::vector<RowId> res;
+
+        auto check = [&](const char* name, auto lookup) {
+            for (auto key : queries) doNotOptimize(lookup(key));
+            uint64_t before = allocStats().allocations;
+            for (int pass = 0; pass < ALLOC_CHECK_PASSES; ++pass) {
+                for (auto key : queries) doNotOptimize(lookup(key));
+            }
+            uint64_t allocations = allocStats().allocations - before;
+            out << size << "," << name << "," << ALLOC_CHECK_PASSES * queries.size() << "," << allocations << "\n";
+            if (allocations != 0) {
+                std::cerr << "[ERROR] " << name << " allocated " << allocations << " times on size " << size << "\n";
+                clean = false;
+            }
+        };
+        check("Linear", [&](std::string_view key) {
+            res.clear();
+            linearSearch(data, key, res);
+            return res.size();
+        });
+        check("LinearSimd", [&](std::string_view key) {
+            res.clear();
+            linearSearchSimd(data, prints, key, res);
+            return res.size();
+        });
+        check("BST", [&](std::string_view key) {
+            res.clear();
+            searchBST(bst, key, res);
+            return res.size();
+        });
+        check("RBT", [&](std::string_view key) { return searchRBT(rbt, key); });
+        check("Hash", [&](std::string_view key) { return ht.search(key); });
+        check("Multimap", [&](std::string_view key) {
+            auto range = mm.equal_range(key);
+            size_t n = 0;
+            for (auto it = range.first; it != range.second; ++it) n += it->second;
+            return n;
+        });
+        check("Eytzinger", [&](std::string_view key) { return eytz.search(key); });
+        check("BPlus", [&](std::string_view key) { return searchBPlus(bplus, key); });
+        check("Registry", [&](std::string_view key) { return registry.search(slot, key, res); });
+        check("RegistryOrdered", [&](std::string_view key) { return registry.searchOrdered(slot, key, res); });
+        std::cout << "Size: " << size << " done.\n";
+    }
+    return clean ? 0 : 1;
+}
+
+// === Бенчмарк конфигураций индексов ===
+// Проходит по IndexConfigs: сборка, память и время поиска по одному и
+// тому же потоку запросов, ответы сверяются с первой конфигурацией.
+int runPolicyBenchmark() {
+    std::ofstream out("policy_results.csv");
+    out << "Size,Index,BuildUs,Bytes,MedianNs,P99Ns\n";
+
+    const int samples = 20;
+    bool consistent = true;
+    for (int size : datasetSizes) {
+        std::string filename = "apartments_" + std::to_string(size) + ".txt";
+        auto data = loadDataset(filename);
+        if (data.empty()) {
+            std::cerr << "[ERROR] Dataset " << filename << " is empty or unreadable.\n";
+            continue;
+        }
+        WorkloadConfig config;
+        config.missRatio = 0.1;
+        QueryTrace trace = generateTrace(data, config);
+        std::vector<std::string_view> queries = trace.views();
+
+        std::vector<size_t> expected;
+        forEachType(IndexConfigs{}, [&]<NameIndex Index>() {
+            Index index;
+            long long buildUs = measureTime([&]() { index.build(data); });
+            std::vector<size_t> counts;
+            for (auto key : queries) {
+                auto [first, last] = index.equalRange(key);
+                counts.push_back(last - first);
+            }
+            if (expected.empty()) expected = counts;
+            else if (counts != expected) {
+                std::cerr << "[ERROR] " << Index::name() << " disagrees with the first index on size " << size << "\n";
+                consistent = false;
+            }
+
+            SampleSet set;
+            sampleLookups(set, queries, [&](std::string_view key) { return index.find(key); }, samples);
+            TimingStats st = set.stats();
+            out << size << "," << Index::name() << "," << buildUs << "," << index.memoryBytes() << ","
+                << st.median << "," << st.p99 << "\n";
+        });
+        std::cout << "Size: " << size << " done.\n";
+    }
+    return consistent ? 0 : 1;
+}
+
+// === Бенчмарк потоковой загрузки ===
+// Последовательная загрузка (loadDataset, затем хеш-таблица и дерево)
+// против конвейера, который строит те же индексы на ходу, при разных
+// размерах кусков, бюджетах памяти и числе разборщиков. Таблица и
+// ответы индексов конвейера сверяются с последовательной загрузкой.
+int runIngestBenchmark() {
+    std::ofstream out("ingest_results.csv");
+    out << "Size,Mode,ParseThreads,ChunkBytes,MemoryCap,RowsPerSec,MBPerSec,PeakBudgetBytes,CapMet,Chunks,"
+           "ColumnGrowths,ReadUtil,ParseUtil,AppendUtil,HashUtil,RBTUtil\n";
+
+    bool consistent = true;
+    for (int size : datasetSizes) {
+        std::string filename = "apartments_" + std::to_string(size) + ".txt";
+        ApartmentTable data;
+        HashTable referenceHash(data);
+        RBTree referenceTree;
+        long long sequentialUs = measureTime([&]() {
+            data = loadDataset(filename);
+            referenceHash.build();
+            for (RowId row = 0; row < data.size(); ++row) insertRBT(referenceTree, data.key(row), row);
+        });
+        if (data.empty()) {
+            std::cerr << "[ERROR] Dataset " << filename << " is empty or unreadable.\n";
+            continue;
+        }
+        double megabytes = (data.names.size() + 0.0) / (1 << 20);
+        struct stat st;
+        if (stat(filename.c_str(), &st) == 0) megabytes = double(st.st_size) / (1 << 20);
+        out << size << ",Sequential,1,NA,NA," << rowsPerSec(data.size(), sequentialUs) << ","
+            << (sequentialUs > 0 ? megabytes * 1e6 / sequentialUs : 0) << ",NA,NA,NA,NA,NA,NA,NA,NA,NA\n";
+        std::vector<std::string_view> keys = distinctKeys(data);
+
+        struct Shape {
+            size_t chunkBytes, memoryCap;
+        };
+        // Бюджеты с запасом на индексы 500k строк (~10 МБ); прогон, где
+        // бюджет всё же превышен, помечается CapMet = 0
+        for (Shape shape : {Shape{64 << 10, 16 << 20}, Shape{1 << 20, 64 << 20}}) {
+            for (size_t parseThreads : {1, 2, 4}) {
+                IngestConfig config;
+                config.chunkBytes = shape.chunkBytes;
+                config.memoryCap = shape.memoryCap;
+                config.parseThreads = parseThreads;
+
+                ApartmentTable table;
+                HashTable hash(table);
+                RBTree tree;
+                // Вставки по строке переносят диапазон ключа в конец postings,
+                // поэтому мусор собирается, как только его больше живых строк
+                std::vector<IngestBuilder> builders = {
+                    {"Hash",
+                     [&](RowId first, RowId last) {
+                         for (RowId row = first; row < last; ++row) hash.insert(row);
+                         if (hash.garbage * 2 > hash.postings.size()) hash.compact();
+                     },
+                     [&]() { return hash.memoryBytes(); }},
+                    {"RBT",
+                     [&](RowId first, RowId last) {
+                         for (RowId row = first; row < last; ++row) insertRBT(tree, table.key(row), row);
+                     },
+                     [&]() { return tree.memoryBytes(); }},
+                };
+                IngestReport report;
+                // Остаток мусора собирается в конце и входит в общее время
+                long long totalUs = measureTime([&]() {
+                    report = ingestDataset(filename, config, table, builders);
+                    hash.compact();
+                });
+                if (!report.ok) {
+                    std::cerr << "[ERROR] Streaming ingestion of " << filename << " failed.\n";
+                    consistent = false;
+                    continue;
+                }
+
+                if (!report.capMet) {
+                    std::cerr << "[WARN] " << filename << ": peak " << report.peakBytes << " bytes exceeds memoryCap "
+                              << config.memoryCap << "\n";
+                }
+
+                bool same = table.names == data.names && table.keyOffset == data.keyOffset &&
+                            table.apartment == data.apartment && table.area == data.area &&
+                            table.rooms == data.rooms && table.price == data.price && table.floor == data.floor;
+                for (size_t i = 0; same && i < keys.size(); ++i) {
+                    std::span<const RowId> expected = referenceHash.search(keys[i]);
+                    std::span<const RowId> byHash = hash.search(keys[i]);
+                    std::span<const RowId> byTree = searchRBT(tree, keys[i]);
+                    same = std::equal(expected.begin(), expected.end(), byHash.begin(), byHash.end()) &&
+                           std::equal(expected.begin(), expected.end(), byTree.begin(), byTree.end());
+                }
+                if (!same) {
+                    std::cerr << "[ERROR] Streaming ingestion disagrees with loadDataset on size " << size << "\n";
+                    consistent = false;
+                }
+
+                out << size << ",Pipeline," << parseThreads << "," << config.chunkBytes << "," << config.memoryCap
+                    << "," << rowsPerSec(report.rows, totalUs) << "," << (totalUs > 0 ? megabytes * 1e6 / totalUs : 0)
+                    << "," << report.peakBytes << "," << report.capMet << "," << report.chunks << ","
+                    << report.columnGrowths;
+                for (const IngestStage& stage : report.stages) out << "," << report.utilization(stage);
+                out << "\n";
+            }
+        }
+        std::cout << "Size: " << size << " done.\n";
+    }
+    return consistent ? 0 : 1;
+}
+
+// === Бенчмарк кеша горячих ключей ===
+// Дерево и хеш-таблица с кешем и без него на потоках запросов с разной
+// асимметрией и бюджетами кеша. Затем реестр с кешем под смешанной
+// нагрузкой; после неё каждый ключ потока сверяется с поиском мимо кеша,
+// устаревший ответ в кеше — ошибка.
+int runCacheBenchmark() {
+    std::ofstream out("cache_results.csv");
+    out << "Size,Zipf,Structure,BudgetBytes,Threads,WritePercent,MedianNs,P99Ns,OpsPerSec,"
+           "HitRatio,Evictions,Rejected,Stale,CacheBytes\n";
+
+    const int samples = 20;
+    const std::vector<std::string>& names = possibleNames();
+    bool consistent = true;
+    for (int size : datasetSizes) {
+        std::string filename = "apartments_" + std::to_string(size) + ".txt";
+        auto data = loadDataset(filename);
+        if (data.empty()) {
+            std::cerr << "[ERROR] Dataset " << filename << " is empty or unreadable.\n";
+            continue;
+        }
+        RBTIndex rbt;
+        rbt.build(data);
+        HashIndex<WyHash> hash;
+        hash.build(data);
+
+        for (double zipf : {0.8, 1.0, 1.2}) {
+            WorkloadConfig config;
+            config.zipf = zipf;
+            config.missRatio = 0.05;
+            config.length = 1 << 16;
+            QueryTrace trace = generateTrace(data, config);
+            std::vector<std::string_view> queries = trace.views();
+
+            // Счётчики кеша — за замеры, без прогревочного прохода
+            auto report = [&](const std::string& name, size_t budget, const SampleSet& set, ResultCache* cache,
+                              const CacheStats& warm) {
+                TimingStats st = set.stats();
+                out << size << "," << zipf << "," << name << "," << budget << ",1,0," << st.median << ","
+                    << st.p99 << "," << (st.mean > 0 ? 1e9 / st.mean : 0) << ",";
+                if (!cache) {
+                    out << "NA,NA,NA,NA,NA\n";
+                    return;
+                }
+                CacheStats cs = cache->stats();
+                cs.hits -= warm.hits;
+                cs.misses -= warm.misses;
+                out << cs.hitRatio() << "," << cs.evictions - warm.evictions << "," << cs.rejected - warm.rejected
+                    << "," << cs.stale - warm.stale << "," << cs.bytes << "\n";
+            };
+
+            std::vector<RowId> res;
+            SampleSet plainRbt, plainHash;
+            sampleLookups(plainRbt, queries, [&](std::string_view key) { return rbt.find(key); }, samples);
+            sampleLookups(plainHash, queries, [&](std::string_view key) { return hash.find(key); }, samples);
+            report("RBT", 0, plainRbt, nullptr, {});
+            report("Hash", 0, plainHash, nullptr, {});
+            for (size_t budget : {size_t(64) << 10, size_t(1) << 20}) {
+                ResultCache rbtCache(budget), hashCache(budget);
+                CachedIndex<RBTIndex> cachedRbt{rbt, rbtCache};
+                CachedIndex<HashIndex<WyHash>> cachedHash{hash, hashCache};
+                // Один проход по потоку наполняет кеш до установившегося режима
+                for (std::string_view key : queries) {
+                    cachedRbt.search(key, res);
+                    cachedHash.search(key, res);
+                }
+                CacheStats warmRbt = rbtCache.stats(), warmHash = hashCache.stats();
+                SampleSet withRbt, withHash;
+                sampleLookups(withRbt, queries, [&](std::string_view key) { return cachedRbt.search(key, res); },
+                              samples);
+                sampleLookups(withHash, queries, [&](std::string_view key) { return cachedHash.search(key, res); },
+                              samples);
+                report("CachedRBT", budget, withRbt, &rbtCache, warmRbt);
+                report("CachedHash", budget, withHash, &hashCache, warmHash);
+            }
+
+            // Реестр с кешем: чтения через кеш, записи его сбрасывают
+            for (int threads : {1, 4}) {
+                const size_t budget = size_t(1) << 20;
+                const int writePercent = 1;
+                Registry registry(data, data.size());
+                ResultCache cache(budget);
+                registry.cache = &cache;
+
+                std::atomic<bool> stop{false};
+                std::atomic<uint64_t> ops{0};
+                std::vector<std::thread> workers;
+                for (int t = 0; t < threads; ++t) {
+                    workers.emplace_back([&, t]() {
+                        ReaderSlot& slot = registry.registerReader();
+                        std::mt19937 rng(2000 + t);
+                        std::vector<RowId> found;
+                        uint64_t local = 0;
+                        size_t next = t;
+                        while (!stop.load(std::memory_order_relaxed)) {
+                            if (int(rng() % 100) < writePercent) {
+                                RowId row = rng() % data.size();
+                                registry.update(row, names[rng() % names.size()]);
+                            }
+                            else {
+                                doNotOptimize(registry.searchCached(slot, queries[next++ % queries.size()], found));
+                            }
+                            local++;
+                        }
+                        ops += local;
+                    });
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(MIX_DURATION_MS));
+                stop = true;
+                for (auto& w : workers) w.join();
+
+                ReaderSlot& slot = registry.registerReader();
+                std::vector<RowId> cached, direct;
+                for (std::string_view key : queries) {
+                    registry.searchCached(slot, key, cached);
+                    registry.search(slot, key, direct);
+                    if (cached != direct) {
+                        std::cerr << "[ERROR] Stale cached result for " << key << " on size " << size << "\n";
+                        consistent = false;
+                        break;
+                    }
+                }
+                CacheStats cs = cache.stats();
+                out << size << "," << zipf << ",CachedRegistry," << budget << "," << threads << "," << writePercent
+                    << ",NA,NA," << ops / (MIX_DURATION_MS / 1000.0) << "," << cs.hitRatio() << "," << cs.evictions
+                    << "," << cs.rejected << "," << cs.stale << "," << cs.bytes << "\n";
+            }
+        }
+        std::cout << "Size: " << size << " done.\n";
+    }
+    return consistent ? 0 : 1;
+}
+
+// === Сервис поиска ===
+// main serve держит таблицу и индексы в памяти и отвечает по Unix-сокету
+// (или TCP на 127.0.0.1) в одном потоке с циклом epoll. Протокол
+// двоичный, little-endian, запросы можно слать пачкой не дожидаясь
+// ответов; ответы приходят в порядке запросов одного соединения.
+//
+// Запрос:  u32 длина тела, u32 id, u8 тип, 3 байта нулей, тело.
+//          REQUEST_NAME — тело это ФИО; REQUEST_RANGE — RangeQuery
+//          (u16 areaMin, u16 areaMax, f32 priceMin, f32 priceMax,
+//          u8 roomsMin, u8 roomsMax, u8 floorMin, u8 floorMax).
+// Ответ:   u32 число строк в ответе, u32 id, u32 всего найдено, строки
+//          по u32. Строк в ответе не больше MAX_RESPONSE_ROWS.
+//
+// Все поиски по ФИО, пришедшие за один проход epoll_wait, идут одним
+// пакетом в HashTable::searchMany. Соединение читается не больше чем
+// до MAX_PENDING_INPUT байт в буфере, а кадры разбираются, только пока
+// неотправленные ответы вместе с худшим случаем отложенных ответов на
+// ФИО не превышают MAX_PENDING_OUTPUT; остальное ждёт в буфере, пока
+// клиент не заберёт ответы. Так клиент, который шлёт запросы и не
+// читает ответы, упирается в свой сокет, а не в память сервера. После
+// закрытия клиентом записи сервер отвечает на уже пришедшие запросы и
+// закрывает соединение.
+const uint8_t REQUEST_NAME = 1;
+const uint8_t REQUEST_RANGE = 2;
+const size_t FRAME_HEADER = 12;
+const size_t RANGE_BODY = 16;
+const uint32_t MAX_REQUEST_BODY = 4096;
+const uint32_t MAX_RESPONSE_ROWS = 4096;
+const size_t MAX_RESPONSE_BYTES = 12 + MAX_RESPONSE_ROWS * sizeof(RowId);
+const size_t MAX_PENDING_OUTPUT = size_t(1) << 20;
+const size_t MAX_PENDING_INPUT = size_t(64) << 10;
+
+inline void putU32(std::vector<char>& out, uint32_t v) {
+    out.insert(out.end(), reinterpret_cast<const char*>(&v), reinterpret_cast<const char*>(&v) + sizeof(v));
+}
+
+inline uint32_t getU32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+void encodeRequest(std::vector<char>& out, uint32_t id, uint8_t type, std::string_view body) {
+    putU32(out, static_cast<uint32_t>(body.size()));
+    putU32(out, id);
+    const char tail[4] = {static_cast<char>(type), 0, 0, 0};
+    out.insert(out.end(), tail, tail + 4);
+    out.insert(out.end(), body.begin(), body.end());
+}
+
+std::string encodeRange(const RangeQuery& q) {
+    std::string body(RANGE_BODY, '\0');
+    char* p = body.data();
+    std::memcpy(p, &q.areaMin, 2);
+    std::memcpy(p + 2, &q.areaMax, 2);
+    std::memcpy(p + 4, &q.priceMin, 4);
+    std::memcpy(p + 8, &q.priceMax, 4);
+    p[12] = static_cast<char>(q.roomsMin);
+    p[13] = static_cast<char>(q.roomsMax);
+    p[14] = static_cast<char>(q.floorMin);
+    p[15] = static_cast<char>(q.floorMax);
+    return body;
+}
+
+RangeQuery decodeRange(const char* p) {
+    RangeQuery q;
+    std::memcpy(&q.areaMin, p, 2);
+    std::memcpy(&q.areaMax, p + 2, 2);
+    std::memcpy(&q.priceMin, p + 4, 4);
+    std::memcpy(&q.priceMax, p + 8, 4);
+    q.roomsMin = static_cast<uint8_t>(p[12]);
+    q.roomsMax = static_cast<uint8_t>(p[13]);
+    q.floorMin = static_cast<uint8_t>(p[14]);
+    q.floorMax = static_cast<uint8_t>(p[15]);
+    return q;
+}
+
+void encodeResponse(std::vector<char>& out, uint32_t id, std::span<const RowId> rows) {
+    uint32_t n = static_cast<uint32_t>(std::min<size_t>(rows.size(), MAX_RESPONSE_ROWS));
+    putU32(out, n);
+    putU32(out, id);
+    putU32(out, static_cast<uint32_t>(rows.size()));
+    out.insert(out.end(), reinterpret_cast<const char*>(rows.data()),
+               reinterpret_cast<const char*>(rows.data() + n));
+}
+
+// Слушающий сокет по --socket или --port; -1 при ошибке
+int openListener(const BenchOptions& options) {
+    int fd;
+    if (options.port > 0) {
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (fd < 0) return -1;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(options.port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    else {
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (fd < 0) return -1;
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, options.socketPath.c_str(), sizeof(addr.sun_path) - 1);
+        unlink(options.socketPath.c_str());
+        if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    if (listen(fd, 1024) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Блокирующее соединение с сервисом; -1 при ошибке
+int connectService(const BenchOptions& options) {
+    int fd;
+    if (options.port > 0) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(options.port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    else {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, options.socketPath.c_str(), sizeof(addr.sun_path) - 1);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+// Дочитывает то, что есть в сокете, пока в буфере меньше limit байт;
+// false — соединение закрыто
+bool readAvailable(int fd, std::vector<char>& in, size_t limit = SIZE_MAX) {
+    char buf[65536];
+    while (in.size() < limit) {
+        ssize_t n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n > 0) in.insert(in.end(), buf, buf + n);
+        else if (n == 0) return false;
+        else return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    return true;
+}
+
+volatile std::sig_atomic_t stopRequested = 0;
+
+void onStopSignal(int) { stopRequested = 1; }
+
+struct ServiceConnection {
+    std::vector<char> in, out;
+    size_t outPos = 0;
+    uint32_t watched = EPOLLIN; // события, на которые подписано соединение
+    size_t deferred = 0;        // ФИО этого прохода, ждущие общего пакета
+    bool touched = false;       // уже разобрано в этом проходе
+    bool eof = false;           // клиент больше ничего не пришлёт
+    bool closed = false;
+};
+
+// Есть ли в буфере целый кадр (или заголовок, по которому ясно, что поток испорчен)
+bool hasFrame(const std::vector<char>& in) {
+    if (in.size() < FRAME_HEADER) return false;
+    uint32_t length = getU32(in.data());
+    return length > MAX_REQUEST_BODY || in.size() - FRAME_HEADER >= length;
+}
+
+// Отправляет накопленный ответ; false — соединение закрыто
+bool flushOutput(int fd, ServiceConnection& c) {
+    while (c.outPos < c.out.size()) {
+        ssize_t n = send(fd, c.out.data() + c.outPos, c.out.size() - c.outPos, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n > 0) c.outPos += n;
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        else if (n < 0 && errno == EINTR) continue;
+        else return false;
+    }
+    if (c.outPos == c.out.size()) {
+        c.out.clear();
+        c.outPos = 0;
+    }
+    return true;
+}
+
+// main serve <apartments_N.txt> [--socket path | --port N]
+int runLookupServer(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: main serve <apartments_N.txt> [--socket path | --port N]\n";
+        return 1;
+    }
+    BenchOptions options = parseOptions(argc, argv, 3);
+    auto data = loadDataset(argv[2]);
+    if (data.empty()) {
+        std::cerr << "[ERROR] Dataset " << argv[2] << " is empty or unreadable.\n";
+        return 1;
+    }
+    HashTable ht(data);
+    ht.build();
+    AttributeIndex attributes(data);
+    attributes.build();
+
+    int listener = openListener(options);
+    int ep = epoll_create1(0);
+    if (listener < 0 || ep < 0) {
+        std::cerr << "[ERROR] Cannot listen: " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    struct sigaction sa{};
+    sa.sa_handler = onStopSignal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = listener;
+    epoll_ctl(ep, EPOLL_CTL_ADD, listener, &ev);
+    std::cout << "Serving " << data.size() << " rows on "
+              << (options.port > 0 ? "127.0.0.1:" + std::to_string(options.port) : options.socketPath) << "\n";
+
+    std::unordered_map<int, ServiceConnection> conns;
+    struct NameRequest {
+        int fd;
+        uint32_t id;
+    };
+    std::vector<NameRequest> names;
+    std::vector<std::string_view> keys;
+    std::vector<std::pair<int, size_t>> touched; // соединение и разобранные байты
+    // Соединения с целыми кадрами в буфере: новых событий для уже
+    // прочитанных байтов не будет, поэтому их разбирают без epoll
+    std::vector<int> ready;
+    BatchResult batch;
+    std::vector<RowId> rangeRows;
+    uint64_t nameRequests = 0, rangeRequests = 0, batches = 0;
+    epoll_event events[256];
+
+    auto runBatch = [&]() {
+        ht.searchMany(keys, batch);
+        batches++;
+        for (size_t i = 0; i < names.size(); ++i) {
+            ServiceConnection& owner = conns[names[i].fd];
+            encodeResponse(owner.out, names[i].id,
+                           std::span<const RowId>(batch.rows.data() + batch.offsets[i], batch.count(i)));
+            owner.deferred = 0;
+        }
+        nameRequests += names.size();
+        names.clear();
+        keys.clear();
+    };
+
+    // Читает соединение (если были события чтения) и разбирает целые кадры
+    auto serve = [&](int fd, uint32_t flags) {
+        ServiceConnection& c = conns[fd];
+        if (c.touched) return;
+        c.touched = true;
+        touched.emplace_back(fd, 0);
+        if ((flags & EPOLLOUT) && !flushOutput(fd, c)) c.closed = true;
+        if ((flags & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !c.eof && !readAvailable(fd, c.in, MAX_PENDING_INPUT)) {
+            c.eof = true;
+        }
+
+        // Разбор целых кадров; ФИО откладываются до общего пакета,
+        // их ключи смотрят прямо в буфер соединения, поэтому разобранные
+        // байты удаляются только после ответа на пакет
+        size_t pos = 0;
+        while (!c.closed && c.in.size() - pos >= FRAME_HEADER) {
+            if (c.out.size() - c.outPos + (c.deferred + 1) * MAX_RESPONSE_BYTES > MAX_PENDING_OUTPUT) break;
+            uint32_t length = getU32(c.in.data() + pos);
+            uint32_t id = getU32(c.in.data() + pos + 4);
+            uint8_t type = static_cast<uint8_t>(c.in[pos + 8]);
+            if (length > MAX_REQUEST_BODY || (type == REQUEST_RANGE && length != RANGE_BODY) ||
+                (type != REQUEST_NAME && type != REQUEST_RANGE)) {
+                c.closed = true; // испорченный поток, дальше кадры не найти
+                break;
+            }
+            if (c.in.size() - pos < FRAME_HEADER + length) break;
+            const char* body = c.in.data() + pos + FRAME_HEADER;
+            if (type == REQUEST_NAME) {
+                names.push_back({fd, id});
+                keys.emplace_back(body, length);
+                c.deferred++;
+            }
+            else {
+                // Ответ на диапазон не должен обогнать отложенные ФИО
+                // этого же соединения, поэтому сначала выполняем пакет
+                if (c.deferred > 0) runBatch();
+                attributes.search(decodeRange(body), rangeRows);
+                encodeResponse(c.out, id, rangeRows);
+                rangeRequests++;
+            }
+            pos += FRAME_HEADER + length;
+        }
+        touched.back().second = pos;
+    };
+
+    while (!stopRequested) {
+        int n = epoll_wait(ep, events, 256, ready.empty() ? -1 : 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        names.clear();
+        keys.clear();
+        touched.clear();
+        for (int e = 0; e < n; ++e) {
+            int fd = events[e].data.fd;
+            if (fd == listener) {
+                for (int client; (client = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK)) >= 0;) {
+                    if (options.port > 0) {
+                        int one = 1;
+                        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    }
+                    epoll_event cev{};
+                    cev.events = EPOLLIN;
+                    cev.data.fd = client;
+                    epoll_ctl(ep, EPOLL_CTL_ADD, client, &cev);
+                    conns[client];
+                }
+                continue;
+            }
+            serve(fd, events[e].events);
+        }
+        for (int fd : ready) {
+            if (conns.count(fd)) serve(fd, 0);
+        }
+        ready.clear();
+        if (!names.empty()) runBatch();
+
+        for (auto [fd, consumed] : touched) {
+            ServiceConnection& c = conns[fd];
+            c.touched = false;
+            c.in.erase(c.in.begin(), c.in.begin() + std::min(consumed, c.in.size()));
+            if (!c.closed && !flushOutput(fd, c)) c.closed = true;
+            // Ответы на всё, что клиент прислал до закрытия, отправлены
+            if (c.eof && c.out.empty() && !hasFrame(c.in)) c.closed = true;
+            if (c.closed) {
+                epoll_ctl(ep, EPOLL_CTL_DEL, fd, nullptr);
+                close(fd);
+                conns.erase(fd);
+                continue;
+            }
+            size_t pending = c.out.size() - c.outPos;
+            bool room = pending + MAX_RESPONSE_BYTES <= MAX_PENDING_OUTPUT;
+            if (room && hasFrame(c.in)) ready.push_back(fd);
+            uint32_t wanted = (pending > 0 ? uint32_t(EPOLLOUT) : 0u) |
+                              (!c.eof && room && c.in.size() < MAX_PENDING_INPUT ? uint32_t(EPOLLIN) : 0u);
+            if (wanted != c.watched) {
+                epoll_event cev{};
+                cev.events = wanted;
+                cev.data.fd = fd;
+                epoll_ctl(ep, EPOLL_CTL_MOD, fd, &cev);
+                c.watched = wanted;
+            }
+        }
+    }
+
+    for (auto& [fd, c] : conns) close(fd);
+    close(listener);
+    close(ep);
+    if (options.port == 0) unlink(options.socketPath.c_str());
+    std::cout << "Served " << nameRequests + rangeRequests << " requests (" << rangeRequests << " ranges) in "
+              << batches << " name batches (" << double(nameRequests) / std::max<uint64_t>(batches, 1)
+              << " names per batch)\n";
+    return 0;
+}
+
+// Квантиль q из отсортированного массива
+double sortedQuantile(const std::vector<double>& sorted, double q) {
+    if (sorted.empty()) return 0;
+    return sorted[std::min(sorted.size() - 1, static_cast<size_t>(sorted.size() * q))];
+}
+
+// main loadgen <apartments_N.txt> [--socket path | --port N] [--seconds S]
+//              [--seed/--zipf/--miss/--queries/--trace]
+// Замкнутый цикл: у каждого соединения ровно один запрос в полёте,
+// следующий уходит сразу после ответа. Каждый 16-й запрос — диапазон
+// по площади, остальные — ФИО из потока запросов.
+int runLoadGenerator(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: main loadgen <apartments_N.txt> [--socket path | --port N] [--seconds S]\n";
+        return 1;
+    }
+    BenchOptions options = parseOptions(argc, argv, 3);
+    auto data = loadDataset(argv[2]);
+    if (data.empty()) {
+        std::cerr << "[ERROR] Dataset " << argv[2] << " is empty or unreadable.\n";
+        return 1;
+    }
+    QueryTrace trace = options.traceFile.empty() ? generateTrace(data, options.workload) : loadTrace(options.traceFile);
+    if (trace.keys.empty()) {
+        std::cerr << "[ERROR] Trace " << options.traceFile << " is empty or unreadable.\n";
+        return 1;
+    }
+    std::vector<std::string> ranges;
+    std::mt19937 rng(static_cast<uint32_t>(options.workload.seed));
+    for (size_t i = 0; i < 64; ++i) {
+        RangeQuery q;
+        q.areaMin = static_cast<uint16_t>(std::uniform_int_distribution<int>(5, 298)(rng));
+        q.areaMax = q.areaMin + 2;
+        ranges.push_back(encodeRange(q));
+    }
+
+    std::ofstream out("loadgen_results.csv");
+    out << "Concurrency,Requests,QPS,P50Us,P99Us,P999Us,Errors\n";
+    using Clock = std::chrono::steady_clock;
+
+    for (int concurrency : {1, 2, 4, 8, 16, 32, 64}) {
+        struct Client {
+            int fd = -1;
+            std::vector<char> in, out;
+            size_t sent = 0;
+            uint32_t id = 0;
+            bool expectHit = false;
+            bool isRange = false;
+            Clock::time_point start;
+        };
+        std::vector<Client> clients(concurrency);
+        int ep = epoll_create1(0);
+        bool connected = ep >= 0;
+        for (int i = 0; i < concurrency && connected; ++i) {
+            clients[i].fd = connectService(options);
+            if (clients[i].fd < 0) {
+                connected = false;
+                break;
+            }
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.u32 = static_cast<uint32_t>(i);
+            epoll_ctl(ep, EPOLL_CTL_ADD, clients[i].fd, &ev);
+        }
+        if (!connected) {
+            std::cerr << "[ERROR] Cannot connect to "
+                      << (options.port > 0 ? "127.0.0.1:" + std::to_string(options.port) : options.socketPath)
+                      << ": " << std::strerror(errno) << "\n";
+            for (auto& c : clients)
+                if (c.fd >= 0) close(c.fd);
+            if (ep >= 0) close(ep);
+            return 1;
+        }
+
+        size_t next = 0;
+        uint32_t nextId = 0;
+        size_t errors = 0;
+        std::vector<double> latencies;
+        auto issue = [&](Client& c) {
+            c.id = nextId++;
+            c.isRange = c.id % 16 == 15;
+            c.out.clear();
+            c.sent = 0;
+            if (c.isRange) {
+                encodeRequest(c.out, c.id, REQUEST_RANGE, ranges[c.id % ranges.size()]);
+            }
+            else {
+                size_t k = next++ % trace.keys.size();
+                c.expectHit = trace.hit[k];
+                encodeRequest(c.out, c.id, REQUEST_NAME, trace.keys[k]);
+            }
+            c.start = Clock::now();
+            // Запрос мал, поэтому почти всегда уходит одним вызовом
+            while (c.sent < c.out.size()) {
+                ssize_t n = send(c.fd, c.out.data() + c.sent, c.out.size() - c.sent, MSG_NOSIGNAL);
+                if (n <= 0 && errno != EINTR) return false;
+                if (n > 0) c.sent += n;
+            }
+            return true;
+        };
+
+        bool failed = false;
+        for (auto& c : clients) failed |= !issue(c);
+        Clock::time_point begin = Clock::now();
+        Clock::time_point end = begin + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.seconds));
+        epoll_event events[64];
+        while (!failed && Clock::now() < end) {
+            int n = epoll_wait(ep, events, 64, 100);
+            if (n < 0 && errno != EINTR) break;
+            for (int e = 0; e < n; ++e) {
+                Client& c = clients[events[e].data.u32];
+                if (!readAvailable(c.fd, c.in)) {
+                    failed = true;
+                    break;
+                }
+                if (c.in.size() < FRAME_HEADER) continue;
+                uint32_t rows = getU32(c.in.data());
+                if (c.in.size() < FRAME_HEADER + size_t(rows) * sizeof(RowId)) continue;
+                Clock::time_point now = Clock::now();
+                latencies.push_back(std::chrono::duration<double, std::micro>(now - c.start).count());
+                uint32_t total = getU32(c.in.data() + 8);
+                if (getU32(c.in.data() + 4) != c.id || (!c.isRange && (total > 0) != c.expectHit)) errors++;
+                c.in.erase(c.in.begin(), c.in.begin() + FRAME_HEADER + size_t(rows) * sizeof(RowId));
+                if (now < end && !issue(c)) failed = true;
+            }
+        }
+        double elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+        for (auto& c : clients) close(c.fd);
+        close(ep);
+        if (failed) {
+            std::cerr << "[ERROR] Connection lost at concurrency " << concurrency << "\n";
+            return 1;
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        out << concurrency << "," << latencies.size() << "," << latencies.size() / elapsed << ","
+            << sortedQuantile(latencies, 0.5) << "," << sortedQuantile(latencies, 0.99) << ","
+            << sortedQuantile(latencies, 0.999) << "," << errors << "\n";
+        std::cout << "Concurrency: " << concurrency << " done.\n";
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "loadbench") return runLoadBenchmark();
+    if (argc > 1 && std::string(argv[1]) == "snapbench") return runSnapshotBenchmark();
+    if (argc > 1 && std::string(argv[1]) == "snapshot") return runSnapshotConverter(argc, argv);
+    if (argc > 1 && std::string(argv[1]) == "batchbench") return runBatchBenchmark();
+    if (argc > 1 && std::string(argv[1]) == "parbench") return runParallelBenchmark();
+    if (argc > 1 && std::string(argv[1]) == "internbench") return runInternBenchmark();
+    if (argc > 1 && std::string(argv[1]) == "prefixbench") return runPrefixBenchmark();
+    if (argc > 1 && std::string(argv[1]) == "rangebench") return runRangeBenchmark();
+    if (argc > 1 && std::string(argv[1]) == "mixbench") return runMixedBenchmark();
+    if (argc > 1 && std::string(argv[1]) == "alloccheck") return runAllocationCheck();
+    if (argc > 1 && std::string(argv[1]) == "policybench") return runPolicyBenchmark();
+    if (argc > 1 && std::string(argv[1]) == "cachebench") return runCacheBenchmark();
+    if (argc > 1 && std::string(argv[1]) == "ingestbench") return runIngestBenchmark();
+    if (argc > 1 && std::string(argv[1]) == "serve") return runLookupServer(argc, argv);
+    if (argc > 1 && std::string(argv[1]) == "loadgen") return runLoadGenerator(argc, argv);
+    if (argc > 1 && std::string(argv[1]) == "gentrace") return runTraceGenerator(argc, argv);
+
+    // Запросы задаются --seed/--zipf/--miss/--queries или берутся из
+    // записанного файла --trace (тогда один и тот же поток на всех размерах)
+    BenchOptions options = parseOptions(argc, argv, 1);
+    const WorkloadConfig& workload = options.workload;
+    const std::string& traceFile = options.traceFile;
+    QueryTrace recorded;
+    if (!traceFile.empty()) {
+        recorded = loadTrace(traceFile);
+        if (recorded.keys.empty()) {
+            std::cerr << "[ERROR] Trace " << traceFile << " is empty or unreadable.\n";
+            return 1;
+        }
+    }
+
+    // В results.csv время поиска — медиана в наносекундах,
+    // полная статистика по замерам — в lookup_stats.csv,
+    // сборка, память и пропускная способность — в structure_metrics.csv
+    const std::vector<std::string> structures = {"Linear", "LinearSimd", "BST", "RBT", "Hash",
+                                                 "Multimap", "Eytzinger", "BPlus"};
+
+    // С --perf к results.csv добавляются счётчики на один поиск
+    // (<Структура><Счётчик>), недоступные пишутся как NA
+    std::unique_ptr<PerfCounters> perf;
+    if (options.perf) {
+        perf = std::make_unique<PerfCounters>();
+        if (!perf->available()) {
+            std::cerr << "[WARN] perf_event_open is unavailable, counter columns will be NA.\n";
+        }
+    }
+
+    std::ofstream out("results.csv");
+    out << "Size,Linear,LinearSimd,BST,RBT,Hash,Multimap,Eytzinger,BPlus,Collisions,AvgProbe,"
+           "BSTBytesPerNode,RBTBytesPerNode,BSTVisits";
+    if (perf) {
+        for (const auto& name : structures) {
+            for (const char* counter : perfCounterNames) out << "," << name << counter;
+        }
+    }
+    out << "\n";
+    std::ofstream stats("lookup_stats.csv");
+    stats << "Size,Structure,MedianNs,P99Ns,MeanNs,StddevNs,Samples,LookupsPerSample\n";
+    // Гистограммы есть только в сборке с -DSEARCH_STATS
+    std::ofstream histOut;
+    if (searchStatsEnabled) {
+        histOut.open("search_histograms.csv");
+        histOut << "Size,Structure,Metric,Bucket,Count\n";
+    }
+    std::ofstream metricsOut("structure_metrics.csv");
+    metricsOut << "Size,Structure,BuildUs,BuildRowsPerSec,Bytes,BytesPerRecord,LookupsPerSec\n";
+
+    int repeats = 10;
+    int samplesPerRepeat = 20;
+
+    for (int size : datasetSizes) {
+        std::string filename = "apartments_" + std::to_string(size) + ".txt";
+        std::map<std::string, StructureMetrics> metrics;
+
+        // Для линейного поиска "сборка" — это загрузка таблицы
+        ApartmentTable data;
+        measureBuild(metrics["Linear"], [&]() { data = loadDataset(filename); });
+
+        if (data.empty()) {
+            std::cerr << "[ERROR] Dataset " << filename << " is empty or unreadable.\n";
+            continue;
+        }
+
+        // Каждая структура строится один раз на размер
+        std::vector<uint32_t> prints;
+        measureBuild(metrics["LinearSimd"], [&]() { prints = buildFingerprints(data); });
+        BSTree bst;
+        measureBuild(metrics["BST"], [&]() {
+            for (RowId row = 0; row < data.size(); ++row) insertBST(bst, data.key(row), row);
+        });
+        RBTree rbt;
+        measureBuild(metrics["RBT"], [&]() {
+            for (RowId row = 0; row < data.size(); ++row) insertRBT(rbt, data.key(row), row);
+        });
+        HashTable ht(data);
+        measureBuild(metrics["Hash"], [&]() { ht.build(); });
+        std::multimap<std::string_view, RowId, CountingLess> mm;
+        measureBuild(metrics["Multimap"], [&]() {
+            for (RowId row = 0; row < data.size(); ++row) mm.insert({data.key(row), row});
+        });
+        EytzingerIndex eytz;
+        measureBuild(metrics["Eytzinger"], [&]() { eytz.build(data); });
+        BPlusTree bplus;
+        measureBuild(metrics["BPlus"], [&]() {
+            for (RowId row = 0; row < data.size(); ++row) insertBPlus(bplus, data.key(row), row);
+        });
+
+        std::vector<RowId> res; // общий буфер ответов, поиск в цикле не выделяет память
+        resetSearchHistograms();
+        for (int rep = 0; rep < repeats; ++rep) {
+            // Каждое повторение — свой поток с seed + rep
+            WorkloadConfig config = workload;
+            config.seed += rep;
+            QueryTrace trace = traceFile.empty() ? generateTrace(data, config) : recorded;
+            std::vector<std::string_view> queries = trace.views();
+            auto sample = [&](const std::string& name, auto lookup) {
+                return sampleLookups(metrics[name].lookups, queries, lookup, samplesPerRepeat, perf.get());
+            };
+
+            sample("Linear", [&](std::string_view key) {
+                res.clear();
+                linearSearch(data, key, res);
+                return res.size();
+            });
+            sample("LinearSimd", [&](std::string_view key) {
+                res.clear();
+                linearSearchSimd(data, prints, key, res);
+                return res.size();
+            });
+            sample("BST", [&](std::string_view key) {
+                res.clear();
+                searchBST(bst, key, res);
+                return res.size();
+            });
+            sample("RBT", [&](std::string_view key) { return searchRBT(rbt, key); });
+            sample("Hash", [&](std::string_view key) { return ht.search(key); });
+            sample("Multimap", [&](std::string_view key) {
+                LookupScope scope(STATS_MULTIMAP);
+                auto range = mm.equal_range(key);
+                size_t n = 0;
+                for (auto it = range.first; it != range.second; ++it) {
+                    countNode();
+                    n += it->second;
+                }
+                return n;
+            });
+            sample("Eytzinger", [&](std::string_view key) { return eytz.search(key); });
+            sample("BPlus", [&](std::string_view key) { return searchBPlus(bplus, key); });
+        }
+
+        out << size;
+        for (const auto& name : structures) out << "," << metrics[name].lookups.stats().median;
+        out << "," << ht.collisions << "," << ht.avgProbe() << ","
+            << double(bst.pool.bytes()) / bst.pool.size() << ","
+            << double(rbt.pool.bytes()) / rbt.pool.size() << ",";
+        // Узлы на поиск считает только сборка с -DSEARCH_STATS
+        const SearchStats& bstStats = searchStats[STATS_BST];
+        if (searchStatsEnabled && bstStats.lookups > 0) out << double(bstStats.nodesTotal) / bstStats.lookups;
+        else out << "NA";
+        if (perf) {
+            for (const auto& name : structures) {
+                for (int i = 0; i < PERF_COUNTERS; ++i) {
+                    double v = metrics[name].lookups.perfPerLookup(i);
+                    out << ",";
+                    if (std::isnan(v)) out << "NA";
+                    else out << v;
+                }
+            }
+        }
+        out << "\n";
+
+        if (searchStatsEnabled) writeSearchHistograms(histOut, size);
+
+        for (const auto& name : structures) {
+            const StructureMetrics& m = metrics[name];
+            TimingStats st = m.lookups.stats();
+            stats << size << "," << name << "," << st.median << "," << st.p99 << "," << st.mean << ","
+                  << st.stddev << "," << st.samples << "," << st.lookupsPerSample << "\n";
+            metricsOut << size << "," << name << "," << m.buildUs << ","
+                       << rowsPerSec(data.size(), m.buildUs) << "," << m.bytes << ","
+                       << double(m.bytes) / data.size() << ","
+                       << (st.mean > 0 ? 1e9 / st.mean : 0) << "\n";
+        }
 
         std::cout << "Size: " << size << " done.\n";
     }